@@ -0,0 +1,156 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--
+-- measures the overhead of the testcase command itself.
+--
+-- Usage: lua bench/overhead.lua [<option> ...]
+--
+-- runs the testcase command with the generated test files that contain the
+-- empty test cases, and reports the startup time, the overhead per test file
+-- and the overhead per test case. the options are passed to the testcase
+-- command (e.g. --lean).
+--
+--- file scope variables
+local concat = table.concat
+local format = string.format
+local timer = require('testcase.timer')
+--- constants
+local LUA = arg[-1] or 'lua'
+local TESTCASE = 'bin/testcase.lua'
+local OPTIONS = concat(arg, ' ')
+-- number of files and number of test cases per file
+local SUITES = {
+    {
+        1,
+        1,
+    },
+    {
+        1,
+        100,
+    },
+    {
+        1,
+        1000,
+    },
+    {
+        1,
+        10000,
+    },
+    {
+        10,
+        100,
+    },
+    {
+        100,
+        10,
+    },
+    {
+        1000,
+        1,
+    },
+}
+local NRUN = 3
+
+--- sh runs the shell command and raises an error on failure
+--- @param cmd string
+local function sh(cmd)
+    local ok = os.execute(cmd)
+    -- lua 5.1 returns the exit status
+    if ok ~= true and ok ~= 0 then
+        error(format('failed to run %q', cmd), 2)
+    end
+end
+
+--- mksuite creates the test files in a new temporary directory
+--- @param nfile number
+--- @param ntest number
+--- @return string dirname
+local function mksuite(nfile, ntest)
+    local dirname = os.tmpname()
+    os.remove(dirname)
+    sh(format('mkdir -p %q', dirname))
+
+    for i = 1, nfile do
+        local lines = {
+            "local testcase = require('testcase')",
+        }
+        for j = 1, ntest do
+            lines[#lines + 1] = format('function testcase.test_%d() end', j)
+        end
+        lines[#lines + 1] = ''
+
+        local f = assert(io.open(format('%s/bench%d_test.lua', dirname, i),
+                                 'w'))
+        f:write(concat(lines, '\n'))
+        f:close()
+    end
+
+    return dirname
+end
+
+--- measure returns the minimum elapsed time to run the test suite in
+--- nanoseconds
+--- @param dirname string
+--- @return integer ns
+local function measure(dirname)
+    local cmd = format('%s %s %s %q > /dev/null', LUA, TESTCASE, OPTIONS,
+                       dirname)
+    local min
+    for _ = 1, NRUN do
+        local t = timer.clock()
+        sh(cmd)
+        t = timer.clock() - t
+        if not min or t < min then
+            min = t
+        end
+    end
+    return min
+end
+
+--- fmtns formats the nanoseconds with the time unit
+--- @param ns number
+--- @return string
+local function fmtns(ns)
+    local v, fmt = timer.format(ns < 0 and 0 or ns)
+    return format(fmt, v)
+end
+
+do
+    -- startup time without any test files
+    local dirname = mksuite(0, 0)
+    local startup = measure(dirname)
+    sh(format('rm -rf %q', dirname))
+
+    print(format('options: %q', OPTIONS))
+    print(format('startup: %s', fmtns(startup)))
+    print('')
+    print(format('%6s %7s %12s %12s %12s', 'files', 'tests', 'total',
+                 'per file', 'per test'))
+    for _, v in ipairs(SUITES) do
+        local nfile, ntest = v[1], v[2]
+        dirname = mksuite(nfile, ntest)
+        local ns = measure(dirname) - startup
+        sh(format('rm -rf %q', dirname))
+        print(format('%6d %7d %12s %12s %12s', nfile, nfile * ntest,
+                     fmtns(ns), fmtns(ns / nfile), fmtns(ns / (nfile * ntest))))
+    end
+end
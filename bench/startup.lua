@@ -0,0 +1,95 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--
+-- measures the startup time of the testcase command with and without the
+-- testcase.core module.
+--
+-- Usage: lua bench/startup.lua [<nrun>]
+--
+-- runs `testcase --help` <nrun> times (default: 100) in each mode, and
+-- reports the minimum and the median of the elapsed time. the separate
+-- shared objects are loaded if the TESTCASE_NO_CORE environment variable is
+-- set.
+--
+--- file scope variables
+local format = string.format
+local sort = table.sort
+local timer = require('testcase.timer')
+--- constants
+local LUA = arg[-1] or 'lua'
+local TESTCASE = 'bin/testcase.lua'
+local NRUN = tonumber(arg[1]) or 100
+
+--- measure returns the elapsed time of each run in nanoseconds
+--- @param env string environment variables of the command
+--- @return integer[] samples sorted samples
+local function measure(env)
+    local cmd = format('%s %s %s --help > /dev/null', env, LUA, TESTCASE)
+    local samples = {}
+    for i = 1, NRUN do
+        local t = timer.clock()
+        os.execute(cmd)
+        samples[i] = timer.clock() - t
+    end
+    sort(samples)
+    return samples
+end
+
+--- fmtns formats the nanoseconds with the time unit
+--- @param ns number
+--- @return string
+local function fmtns(ns)
+    local v, fmt = timer.format(ns)
+    return format(fmt, v)
+end
+
+do
+    local core = pcall(require, 'testcase.core')
+    if not core then
+        print('testcase.core module is not installed')
+    end
+
+    print(format('%-12s %12s %12s', 'mode', 'min', 'median'))
+    local results = {}
+    for _, v in ipairs({
+        {
+            'separate',
+            'TESTCASE_NO_CORE=1',
+        },
+        {
+            'core',
+            '',
+        },
+    }) do
+        local samples = measure(v[2])
+        results[v[1]] = samples
+        print(format('%-12s %12s %12s', v[1], fmtns(samples[1]),
+                     fmtns(samples[math.ceil(NRUN / 2)])))
+    end
+
+    if core then
+        local a = results.separate[math.ceil(NRUN / 2)]
+        local b = results.core[math.ceil(NRUN / 2)]
+        print(format('\nmedian gain: %s (%.1f%%)', fmtns(a > b and a - b or 0),
+                     (a - b) / a * 100))
+    end
+end
@@ -19,34 +19,139 @@
 -- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 -- THE SOFTWARE.
 --
+--- register the native modules in the single shared object to package.preload
+--- to avoid loading the separate shared objects. set TESTCASE_NO_CORE to
+--- load the separate shared objects.
+if not os.getenv('TESTCASE_NO_CORE') then
+    pcall(require, 'testcase.core')
+end
 --- prevent sigpipe
 require('testcase.nosigpipe')
 --- file scope variables
+local collectgarbage = collectgarbage
 local ipairs = ipairs
 local pcall = pcall
+local pairs = pairs
+local tonumber = tonumber
+local tostring = tostring
 local realpath = require('testcase.realpath')
 local eval = require('testcase.eval')
 local osexit = require('testcase.exit').exit
 local print = require('testcase.printer').new(nil, '\n')
 local printCode = require('testcase.printer').new('  >     ', '\n')
+local fmtsec = require('testcase.printer').fmtsec
 local getfiles = require('testcase.filesystem').getfiles
 local getopts = require('testcase.getopts')
 local registry = require('testcase.registry')
 local runner = require('testcase.runner')
+local timer = require('testcase.timer')
 local ENOENT = require('errno').ENOENT
+local format = string.format
+local match = string.match
+-- the modules of the options are required when the options are used. the
+-- trace module is loaded by the --trace option or the modules that use it.
+local loaded = package.loaded
 local ARGV = _G.arg
 local HEADLINE = string.rep('=', 80)
+local HR = string.rep('-', 80)
 local USAGE = [[
 testcase - a small helper tool to run the test files
 
 Usage:
-  testcase [--help] [--coverage] [--checkall] <pathname>
+  testcase [--help] [--coverage] [--checkall] [--run=<pattern>]
+           [--skip=<pattern>] [--stream] [--lean] [--leakcheck[=<n>]]
+           [--tmpdir[=<dir>]] [--fdcheck[=warn|fail]] [--icount]
+           [--bench[=<n>]] [--bench-warmup=<n>] [--bench-cpu=<n>]
+           [--samples=<n>] [--baseline=<file>] [--compare=<file>]
+           [--threshold=<percent>] [--fuzz-runs=<n>] [--fuzz-seed=<n>]
+           [--fuzz-corpus=<dir>] [--fuzz-workers=<n>] [--fuzz-coverage]
+           [--limit-cpu=<sec>] [--limit-memory=<size>] [--limit-as=<size>]
+           [--limit-nofile=<n>] [--limit-nproc=<n>] [--record=<file>]
+           [--trace=<file>] [--metrics=<file>] [--journal=<file>]
+           [--resume=<file>]
+           <pathname>
+  testcase --replay=<file>
 
 Options:
-  --help        show this help message and exit
-  --coverage    do code coverage analysis with `luacov`
-  --checkall    any file with a `.lua` extension will be evaluated as a test file
+  --help            show this help message and exit
+  --coverage        do code coverage analysis with `luacov`
+  --checkall        any file with a `.lua` extension will be evaluated as a
+                    test file
+  --run=<pattern>   run only the test cases whose `file:testname` matches the
+                    lua pattern
+  --skip=<pattern>  skip the test cases whose `file:testname` matches the lua
+                    pattern
+  --stream          load, run and release the test files one by one to bound
+                    the memory usage to the largest test file
+  --lean            skip the full garbage collection before each test case
+  --leakcheck[=<n>] run each test case <n> (default: 5) more times and report
+                    the test cases whose retained heap keeps growing
+  --tmpdir[=<dir>]  run each test case in a new scratch directory created in
+                    <dir> (default: /dev/shm if exists, otherwise $TMPDIR or
+                    /tmp) and remove it after the test case
+  --fdcheck[=warn|fail]
+                    report the file descriptors and the child processes that
+                    are left open or alive by each test case, and fail the
+                    test case (default) or only print a warning
+  --icount          count the VM instructions and the C function calls of
+                    each test case
+  --bench[=<n>]     benchmark mode; run each succeeded test case <n>
+                    (default: 10) more times with the garbage collector
+                    stopped, and report the mean, the standard deviation and
+                    the minimum of the elapsed time
+  --bench-warmup=<n>
+                    number of the warmup runs before the measured runs in the
+                    benchmark mode (default: 3)
+  --bench-cpu=<n>   pin the process to the CPU <n> in the benchmark mode
+  --samples=<n>     run each test case <n> times to collect the elapsed time
+                    samples (default: 10 with --baseline or --compare)
+  --baseline=<file> save the elapsed time samples to the baseline file
+  --compare=<file>  compare the elapsed time samples with the baseline file
+                    by the Mann-Whitney U test, and exit with failure if any
+                    test case is significantly slower than the threshold
+  --threshold=<percent>
+                    threshold of the slowdown in percent (default: 5)
+  --fuzz-runs=<n>   number of executions of each fuzz target (default: 10000)
+  --fuzz-seed=<n>   seed of the random number generator for the fuzz targets
+  --fuzz-corpus=<dir>
+                    keep the interesting and failing inputs of each fuzz
+                    target in <dir>/<target name>
+  --fuzz-workers=<n>
+                    run each fuzz target in <n> forked processes (default: 1)
+  --fuzz-coverage   keep the inputs that reach the new lines in the corpus. it
+                    runs the fuzz targets with the line hook, which slows
+                    them down and suspends the other hooks such as `luacov`
+  --limit-cpu=<sec> fail the test case that consumes the CPU time more than
+                    <sec> seconds
+  --limit-memory=<size>
+                    fail the test case that allocates more than <size> bytes
+                    of lua memory. <size> can have K, M or G suffix
+  --limit-as=<size> run each test case in a child process with the address
+                    space limited to <size> bytes
+  --limit-nofile=<n>
+                    run each test case in a child process with the number of
+                    open files limited to <n>
+  --limit-nproc=<n> run each test case in a child process with the number of
+                    processes of the user limited to <n>
+  --record=<file>   write the results of the test cases to <file> as a run log
+  --replay=<file>   print the results in the run log written by --record
+                    option without running the test cases
+  --trace=<file>    write the timeline of the run to <file> in the Chrome
+                    trace event format
+  --metrics=<file>  write the metrics of the run to <file> in the OpenMetrics
+                    text format
+  --journal=<file>  append the result of each test case to <file> so that an
+                    interrupted run can be resumed by --resume option
+  --resume=<file>   skip the test cases that succeeded in the journal <file>,
+                    reuse their results and append the new results to it
 ]]
+local DEFAULT_SAMPLES = 10
+local SIZE_UNITS = {
+    [''] = 1,
+    K = 1024,
+    M = 1024 * 1024,
+    G = 1024 * 1024 * 1024,
+}
 
 --- exit with code and message
 --- @param code number
@@ -56,16 +161,31 @@ local function exit(code, msg, ...)
     if msg then
         print(msg, ...)
     end
+    local trace = loaded['testcase.trace']
+    if trace then
+        trace.stop()
+    end
     osexit(code)
 end
 
+--- set the runner option or exit with the error message
+--- @param name string
+--- @param val any
+--- @param setter function? option setter of the module (default: runner)
+local function setopt(name, val, setter)
+    local ok, err = pcall(setter or runner.setopt, name, val)
+    if not ok then
+        exit(-1, err)
+    end
+end
+
 --- Check command line options and return options table
 --- @return table opts
 local function check_opts()
     local opts = getopts(ARGV)
     if opts['--help'] then
         exit(0, USAGE)
-    elseif not opts[1] then
+    elseif not opts[1] and not opts['--replay'] then
         exit(-1, USAGE)
     elseif opts['--coverage'] then
         local ok, err = pcall(require, 'luacov')
@@ -74,6 +194,149 @@ local function check_opts()
         end
     end
 
+    for _, k in ipairs({
+        '--run',
+        '--skip',
+    }) do
+        if opts[k] == true then
+            exit(-1, 'option %s requires a pattern', k)
+        end
+    end
+    local err = registry.setfilter(opts['--run'], opts['--skip'])
+    if err then
+        exit(-1, 'invalid --run or --skip option: %s', err)
+    end
+
+    if opts['--lean'] then
+        setopt('lean', opts['--lean'])
+    end
+    if opts['--leakcheck'] then
+        local v = opts['--leakcheck']
+        setopt('leakcheck', tonumber(v) or v)
+    end
+    if opts['--tmpdir'] then
+        setopt('tmpdir', opts['--tmpdir'])
+    end
+    if opts['--fdcheck'] then
+        setopt('fdcheck', opts['--fdcheck'])
+    end
+    if opts['--icount'] then
+        setopt('icount', opts['--icount'])
+        if opts['--coverage'] then
+            print('warning: --icount chains to the hook of --coverage, ' ..
+                      'so the test cases run slower while measuring')
+        end
+    end
+
+    for _, k in ipairs({
+        '--baseline',
+        '--compare',
+        '--samples',
+        '--threshold',
+        '--record',
+        '--replay',
+        '--trace',
+        '--metrics',
+        '--journal',
+        '--resume',
+    }) do
+        if opts[k] == true then
+            exit(-1, 'option %s requires a value', k)
+        end
+    end
+    if opts['--samples'] then
+        local v = opts['--samples']
+        setopt('samples', tonumber(v) or v)
+    elseif opts['--baseline'] or opts['--compare'] then
+        setopt('samples', DEFAULT_SAMPLES)
+    end
+    if opts['--threshold'] then
+        local v = tonumber(opts['--threshold'])
+        if not v or v < 0 then
+            exit(-1, 'invalid --threshold option: unsigned number expected')
+        end
+        opts['--threshold'] = v
+    end
+    if opts['--fuzz-coverage'] then
+        setopt('coverage', true, require('testcase.fuzz').setopt)
+    end
+    for _, k in ipairs({
+        'runs',
+        'seed',
+        'corpus',
+        'workers',
+    }) do
+        local v = opts['--fuzz-' .. k]
+        if v == true then
+            exit(-1, 'option --fuzz-%s requires a value', k)
+        elseif v then
+            setopt(k, k == 'corpus' and v or tonumber(v) or v,
+                   require('testcase.fuzz').setopt)
+        end
+    end
+
+    local bench
+    for _, k in ipairs({
+        'warmup',
+        'cpu',
+    }) do
+        local v = opts['--bench-' .. k]
+        if v == true then
+            exit(-1, 'option --bench-%s requires a value', k)
+        elseif v then
+            bench = bench or {}
+            bench[k] = tonumber(v) or v
+        end
+    end
+    if opts['--bench'] then
+        bench = bench or {}
+        if opts['--bench'] ~= true then
+            local v = opts['--bench']
+            bench['repeat'] = tonumber(v) or v
+        end
+    end
+    if bench then
+        setopt('bench', bench)
+    end
+
+    local limit
+    for _, k in ipairs({
+        'cpu',
+        'memory',
+        'as',
+        'nofile',
+        'nproc',
+    }) do
+        local v = opts['--limit-' .. k]
+        if v == true then
+            exit(-1, 'option --limit-%s requires a value', k)
+        elseif v then
+            local n, unit = match(v, '^([%d.]+)([KMG]?)$')
+            n = tonumber(n)
+            if not n or (unit ~= '' and k ~= 'memory' and k ~= 'as') then
+                exit(-1, 'invalid --limit-%s option: %s', k, v)
+            end
+            limit = limit or {}
+            limit[k] = n * SIZE_UNITS[unit]
+        end
+    end
+    if limit then
+        setopt('limit', limit)
+    end
+
+    if opts['--journal'] and opts['--resume'] then
+        exit(-1, 'option --journal cannot be used with --resume')
+    end
+
+    if opts['--compare'] then
+        local baseline = require('testcase.baseline')
+        local samples, err = baseline.load(opts['--compare'])
+        if not samples then
+            exit(-1, 'failed to load the baseline file: %s', err)
+        end
+        opts.baseline = samples
+    end
+
     return opts
 end
 
@@ -96,7 +359,15 @@ end
 --- @return table files
 local function get_files(opts)
     local pathname = check_pathname(opts[1])
+    local trace = loaded['testcase.trace']
+    local span = trace and trace.begin('getfiles', 'load')
     local files, err = getfiles(pathname, opts['--checkall'] and '.lua')
+    if span then
+        trace.finish(span, {
+            pathname = pathname,
+            nfile = files and #files,
+        })
+    end
     if err then
         exit(-1, 'failed to get test files from %q: %s', pathname, err)
     end
@@ -110,7 +381,14 @@ local function loadfiles(files)
     local errfiles = {}
 
     for _, filename in ipairs(files) do
+        local trace = loaded['testcase.trace']
+        local span = trace and trace.begin(filename, 'load')
         local ok, err = eval(filename)
+        if span then
+            trace.finish(span, {
+                ok = ok,
+            })
+        end
         if not ok then
             errfiles[#errfiles + 1] = {
                 filename,
@@ -122,19 +400,20 @@ local function loadfiles(files)
     return errfiles
 end
 
-do
-    local opts = check_opts()
-    local files = get_files(opts)
-
-    -- load test files
-    runner.block()
-    local errfiles = loadfiles(files)
-
-    -- print test info
-    local list, ntest = registry.getlist()
+--- print_header prints the test information
+--- @param errfiles table<number, table<string, string>>
+--- @param list table?
+--- @param ntest number?
+--- @param nfile number?
+local function print_header(errfiles, list, ntest, nfile)
     print('')
     print('Test on %s', os.date('%FT%H:%M:%S%z'))
     print(HEADLINE, '\n')
+    if not list then
+        print('Total: %d test files (streaming mode).\n', nfile)
+        return
+    end
+
     print('Total: %d test cases in %d files.\n', ntest, #list)
     for _, src in ipairs(list) do
         print('- ', src.name, ' has `', #src.tests, '` test cases')
@@ -146,24 +425,313 @@ do
             print('- %s', v[1])
         end
     end
+end
+
+--- run_all loads all test files before running the test cases
+--- @param files table<number, string>
+--- @return number nsuccess
+--- @return number nfailure
+--- @return userdata timer
+--- @return table[] errors
+--- @return table<number, table<string, string>> errfiles
+--- @return table<string, number[]> samples
+local function run_all(files)
+    -- load test files
+    runner.block()
+    local errfiles = loadfiles(files)
+    local list, ntest = registry.getlist()
+    print_header(errfiles, list, ntest)
     runner.unblock()
 
-    local ok, err, nsuccess, nfailure, t, errors = runner.run()
+    local ok, err, nsuccess, nfailure, t, errors, samples = runner.run()
     if not ok then
         exit(-1, 'failed to runner.run(): ', err)
     end
+    return nsuccess, nfailure, t, errors, errfiles, samples
+end
+
+--- run_stream loads and runs the test files one by one, and releases the
+--- registered test cases of each file before loading the next file.
+--- @param files table<number, string>
+--- @return number nsuccess
+--- @return number nfailure
+--- @return userdata timer
+--- @return table[] errors
+--- @return table<number, table<string, string>> errfiles
+--- @return table<string, number[]> samples
+local function run_stream(files)
+    local t = timer.new()
+    local nsuccess = 0
+    local nfailure = 0
+    local errors = {
+        count = 0,
+    }
+    local samples = {}
+
+    print_header(nil, nil, nil, #files)
+    local errfiles = {}
+    for _, filename in ipairs(files) do
+        registry.clear()
+        runner.block()
+        local errfile = loadfiles({
+            filename,
+        })[1]
+        runner.unblock()
+
+        if errfile then
+            errfiles[#errfiles + 1] = errfile
+        end
+
+        -- run the test cases registered before the file failed to load as
+        -- run_all does
+        local ok, err, nsucc, nfail, _, errs, list = runner.run(t)
+        if not ok then
+            exit(-1, 'failed to runner.run(): ', err)
+        end
+        nsuccess = nsuccess + nsucc
+        nfailure = nfailure + nfail
+        for _, v in ipairs(errs) do
+            errors[#errors + 1] = v
+        end
+        errors.count = errors.count + errs.count
+        for k, v in pairs(list) do
+            samples[k] = v
+        end
+
+        -- release the test cases of this file
+        registry.clear()
+        collectgarbage('collect')
+    end
+
+    return nsuccess, nfailure, t, errors, errfiles, samples
+end
+
+--- record_events writes the events of the runner to the run log file
+--- @param pathname string
+--- @return file* f
+local function record_events(pathname)
+    local f, err = io.open(pathname, 'wb')
+    if not f then
+        exit(-1, 'failed to open the run log file: %s', err)
+    end
+    f:setvbuf('full')
+    local encode = require('testcase.record').encode
+    runner.listen(function(event)
+        f:write(encode(event))
+    end)
+    return f
+end
+
+--- open_journal opens the journal file and writes the events of the runner
+--- to it. if resume is true, the test cases that succeeded in the journal
+--- are excluded from the run and returned.
+--- @param pathname string
+--- @param resume boolean?
+--- @return testcase.journal j
+--- @return table[] passed
+local function open_journal(pathname, resume)
+    local journal = require('testcase.journal')
+    local passed = {}
+    if resume then
+        local list, err = journal.load(pathname)
+        if not list then
+            exit(-1, 'failed to load the journal file: %s', err)
+        end
+        local ids = {}
+        for id, event in pairs(list) do
+            ids[id] = true
+            passed[#passed + 1] = event
+        end
+        table.sort(passed, function(a, b)
+            if a.file == b.file then
+                return a.name < b.name
+            end
+            return a.file < b.file
+        end)
+        registry.setexclude(ids)
+    end
+
+    local j, err = journal.new(pathname, resume)
+    if not j then
+        exit(-1, 'failed to open the journal file: %s', err)
+    end
+    runner.listen(function(event)
+        local ok, werr = j:write(event)
+        if not ok then
+            exit(-1, 'failed to write the journal file: %s', tostring(werr))
+        end
+    end)
+    return j, passed
+end
+
+--- replay prints the results in the run log file and exits
+--- @param pathname string
+local function replay(pathname)
+    local f, err = io.open(pathname, 'rb')
+    if not f then
+        exit(-1, 'failed to open the run log file: %s', err)
+    end
+    local data = f:read('*a') or ''
+    f:close()
+
+    local decode = require('testcase.record').decode
+    local nsuccess = 0
+    local nfailure = 0
+    local total = 0
+    local errors = {}
+    local pos = 1
+    while pos <= #data do
+        local event, nextpos = decode(data, pos)
+        if not event then
+            exit(-1, 'failed to read the run log file %q: %s', pathname,
+                 nextpos or 'truncated record')
+        end
+        pos = nextpos
+
+        if event.event == 'file' then
+            print('')
+            print(HR)
+            print('%s: %d test cases', event.file, event.ntest)
+            print(HR)
+        elseif event.event == 'test' then
+            local v, fmt = timer.format(event.elapsed)
+            total = total + event.elapsed
+            print('- %s ... %s (' .. fmt .. ')', event.name,
+                  event.ok and 'ok' or 'fail', v)
+            if event.error then
+                printCode('%s', event.error)
+            end
+        elseif event.event == 'done' then
+            nsuccess = nsuccess + event.nsuccess
+            nfailure = nfailure + event.nfailure
+            print('\n%d successes, %d failures', event.nsuccess,
+                  event.nfailure)
+            if #event.errors > 0 then
+                errors[#errors + 1] = event
+            end
+        end
+    end
+
+    local v, fmt = timer.format(total)
+    print('')
+    print(HR)
+    print('')
+    print('### Total: %d successes, %d failures (' .. fmt .. ')', nsuccess,
+          nfailure, v, '\n')
+    for _, event in ipairs(errors) do
+        print('#### %d testcases in %s failed\n', #event.errors, event.file)
+        for _, verr in ipairs(event.errors) do
+            print('- %s', verr.name)
+            printCode('%s', verr.error)
+            print('')
+        end
+    end
+
+    exit(nfailure > 0 and -1 or 0)
+end
+
+--- compare_baseline prints the comparison with the baseline samples and
+--- returns the number of regressions
+--- @param opts table
+--- @param samples table<string, number[]>
+--- @return number nregression
+local function compare_baseline(opts, samples)
+    local baseline = require('testcase.baseline')
+    local results = baseline.compare(opts.baseline, samples,
+                                     opts['--threshold'])
+    local nregression = 0
+    print('%s', format('#### Comparison with %s (threshold: %s%%)\n',
+                       opts['--compare'], opts['--threshold'] or 5))
+    for _, v in ipairs(results) do
+        local mark = ''
+        if v.regression then
+            nregression = nregression + 1
+            mark = ' REGRESSION'
+        elseif v.significant then
+            mark = ' significant'
+        end
+        -- the result string is passed as an argument since it contains '%'
+        print('%s', format('- %s: %s -> %s (%+.2f%%, p=%.4f)%s', v.name,
+                           fmtsec(v.base), fmtsec(v.cur), v.delta, v.p, mark))
+    end
+    print('\n%d regressions in %d test cases\n', nregression, #results)
+    return nregression
+end
+
+do
+    local opts = check_opts()
+    if opts['--replay'] then
+        replay(opts['--replay'])
+    end
+    if opts['--trace'] then
+        local ok, err = require('testcase.trace').start(opts['--trace'])
+        if not ok then
+            exit(-1, 'failed to open the trace file: %s', err)
+        end
+    end
+    local files = get_files(opts)
+    local logfile = opts['--record'] and record_events(opts['--record'])
+    local jfile, passed
+    if opts['--journal'] or opts['--resume'] then
+        jfile, passed = open_journal(opts['--journal'] or opts['--resume'],
+                                     opts['--resume'] ~= nil)
+    end
+    local events
+    if opts['--metrics'] then
+        events = {}
+        runner.listen(function(event)
+            events[#events + 1] = event
+        end)
+    end
+    local run = opts['--stream'] and run_stream or run_all
+    local nsuccess, nfailure, t, errors, errfiles, samples = run(files)
+    if jfile then
+        jfile:close()
+        -- count the test cases that passed in the previous run and still
+        -- match the registered and unfiltered test cases
+        local ids = registry.excluded()
+        local list = {}
+        for _, v in ipairs(passed) do
+            if ids[v.file .. ':' .. v.name] then
+                list[#list + 1] = v
+            end
+        end
+        passed = list
+        nsuccess = nsuccess + #passed
+    end
 
     local total, fmt = t:total()
     print('### Total: %d successes, %d failures, %d load failures (' .. fmt ..
               ')', nsuccess, nfailure, #errfiles, total, '\n')
 
+    -- print the test cases that succeeded in the resumed run
+    if passed and #passed > 0 then
+        print('#### %d test cases passed in the previous run\n', #passed)
+        for _, v in ipairs(passed) do
+            print('- %s:%s', v.file, v.name)
+        end
+        print('')
+    end
+
+    -- print the summaries of the load tests. the load module is loaded by the
+    -- test files that define the load tests.
+    local loadtest = loaded['testcase.load']
+    local loads = loadtest and loadtest.results() or {}
+    if #loads > 0 then
+        print('#### %d load tests\n', #loads)
+        for _, v in ipairs(loads) do
+            print('- %s', loadtest.tostring(v))
+        end
+        print('')
+    end
+
     -- print errors of each test cases
     if #errors > 0 then
         for _, v in ipairs(errors) do
             print('#### %d testcases in %s failed\n', #v.errors, v.name)
             for _, verr in ipairs(v.errors) do
                 print('- %s', verr.name)
-                printCode('%s', verr.error)
+                printCode('%s', tostring(verr.error))
                 print('')
             end
         end
@@ -175,13 +743,45 @@ do
         print('#### %d test files failed to load\n', #errfiles)
         for _, v in ipairs(errfiles) do
             print('- %s', v[1])
-            printCode('%s', v[2])
+            printCode('%s', tostring(v[2]))
         end
         print('\n')
     end
 
+    if logfile then
+        logfile:close()
+    end
+    if events then
+        local metrics = require('testcase.metrics')
+        local ok, err = metrics.write(opts['--metrics'], events, {
+            nsuccess = nsuccess,
+            nfailure = nfailure,
+            nloadfailure = #errfiles,
+            total = t:nsec(),
+        })
+        if not ok then
+            exit(-1, 'failed to write the metrics file: %s', err)
+        end
+    end
+
+    -- save and compare the elapsed time samples
+    if opts['--baseline'] then
+        local baseline = require('testcase.baseline')
+        local ok, err = baseline.save(opts['--baseline'], samples)
+        if not ok then
+            exit(-1, 'failed to save the baseline file: %s', err)
+        end
+    end
+    local nregression = 0
+    if opts.baseline then
+        nregression = compare_baseline(opts, samples)
+    end
+
+    if loaded['testcase.trace'] then
+        loaded['testcase.trace'].stop()
+    end
     -- exit failure
-    if nfailure > 0 or #errfiles > 0 then
+    if nfailure > 0 or #errfiles > 0 or nregression > 0 then
         exit(-1)
     end
 end
@@ -0,0 +1,380 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local assert = assert
+local error = error
+local ipairs = ipairs
+local next = next
+local setmetatable = setmetatable
+local tostring = tostring
+local type = type
+local format = string.format
+local max = math.max
+local traceback = debug.traceback
+local create = coroutine.create
+local resume = coroutine.resume
+local running = coroutine.running
+local status = coroutine.status
+local yield = coroutine.yield
+local timer = require('testcase.timer')
+local poll = require('testcase.poll')
+--- constants
+-- a unique value to distinguish the yields of the scheduler from others
+local AWAIT = {}
+-- coroutines managed by the scheduler
+local SCHEDULED = setmetatable({}, {
+    __mode = 'k',
+})
+
+--- monotime returns the real monotonic time in seconds for the timeouts of
+--- the descriptors and the processes that are waited in real time.
+--- @return number sec
+local function monotime()
+    return assert(timer.clock()) / 1e9
+end
+
+--- sleeptime returns the time in seconds for the deadlines of the sleeping
+--- tasks. it follows the virtual clock if enabled as same as timer.sleep.
+--- @return number sec
+local function sleeptime()
+    if timer.virtual() then
+        return assert(timer.nanotime())
+    end
+    return monotime()
+end
+
+--- is_scheduled returns true if the current coroutine is managed by the
+--- scheduler
+--- @return boolean
+local function is_scheduled()
+    local co = running()
+    return co ~= nil and SCHEDULED[co] ~= nil
+end
+
+--- await yields to the scheduler if the current coroutine is managed by the
+--- scheduler
+--- @param kind string
+--- @param ident any
+--- @param timeout number?
+--- @return boolean ok false on timeout
+local function await(kind, ident, timeout)
+    if timeout ~= nil and (type(timeout) ~= 'number' or timeout < 0) then
+        error(format('invalid timeout (unsigned number expected, got %s)',
+                     tostring(timeout)), 3)
+    end
+    local ok, err = yield(AWAIT, kind, ident, timeout)
+    if err then
+        -- the event cannot be waited (e.g. already waited by another test)
+        error(err, 3)
+    end
+    return ok
+end
+
+--- sleep suspends the current test for sec seconds
+--- @param sec number
+local function sleep(sec)
+    if type(sec) ~= 'number' or sec < 0 then
+        error(format('invalid argument #1 (unsigned number expected, got %s)',
+                     tostring(sec)), 2)
+    elseif not is_scheduled() then
+        timer.sleep(sec)
+        return
+    end
+    await('sleep', nil, sec)
+end
+
+--- wait_fd waits for the readiness of the descriptor
+--- @param mode string
+--- @param ident integer|table|userdata descriptor or object with fd() method
+--- @param timeout number?
+--- @return boolean ok false on timeout
+local function wait_fd(mode, ident, timeout)
+    if is_scheduled() then
+        return await(mode, ident, timeout)
+    end
+
+    local p = assert(poll.new())
+    local ok, err = p:add(ident, mode)
+    if not ok then
+        p:close()
+        error(err, 3)
+    end
+    local evs
+    evs, err = p:wait(timeout)
+    p:close()
+    if not evs then
+        error(err, 3)
+    end
+    return #evs > 0
+end
+
+--- readable waits until the descriptor becomes readable
+--- @param ident integer|table|userdata descriptor or object with fd() method
+--- @param timeout number?
+--- @return boolean ok false on timeout
+local function readable(ident, timeout)
+    return wait_fd('r', ident, timeout)
+end
+
+--- writable waits until the descriptor becomes writable
+--- @param ident integer|table|userdata descriptor or object with fd() method
+--- @param timeout number?
+--- @return boolean ok false on timeout
+local function writable(ident, timeout)
+    return wait_fd('w', ident, timeout)
+end
+
+--- wait waits for the child process created by testcase.fork to exit and
+--- reaps it
+--- @param proc userdata testcase.process
+--- @param timeout number?
+--- @return table? result
+--- @return string? err
+--- @return boolean? again true on timeout
+local function wait(proc, timeout)
+    if not is_scheduled() then
+        return proc:wait(timeout)
+    elseif not await('exit', proc, timeout) then
+        return nil, nil, true
+    end
+    return proc:wait()
+end
+
+--- new_task creates a task of the scheduler
+--- @param func function
+--- @return table task
+local function new_task(func)
+    local co = create(func)
+    SCHEDULED[co] = true
+    return {
+        co = co,
+        -- arguments to resume the coroutine
+        args = {},
+    }
+end
+
+--- step resumes the task and returns true if the task is finished
+--- @param task table
+--- @param handler table
+--- @return boolean done
+local function step(task, handler)
+    handler.resume(task)
+    local args = task.args
+    local ok, v, kind, ident, timeout = resume(task.co, args[1], args[2],
+                                               args[3])
+    handler.suspend(task)
+
+    if not ok then
+        task.ok = false
+        task.err = traceback(task.co, v)
+        return true
+    elseif status(task.co) == 'dead' then
+        task.ok = true
+        return true
+    end
+
+    task.args = {}
+    if v ~= AWAIT then
+        -- yielded by others; resume it in next loop
+        return false
+    end
+
+    task.kind = kind
+    task.ident = ident
+    if timeout then
+        task.deadline = (kind == 'sleep' and sleeptime() or monotime()) +
+                            timeout
+    else
+        task.deadline = nil
+    end
+    return false
+end
+
+--- run runs the functions concurrently. each function can suspend itself by
+--- sleep, readable, writable and wait functions until the waiting event
+--- occurs, and other functions can run in the meantime.
+--- the handler table must have the following functions;
+---  start(task): called before the task is resumed for the first time
+---  resume(task): called before the task is resumed
+---  suspend(task): called after the task is suspended or finished
+---  finish(task): called when the task is finished. task.ok and task.err
+---                are set to the result.
+--- @param funcs table<number, function>
+--- @param handler table
+local function run(funcs, handler)
+    local tasks = {}
+    local ready = {}
+    local p
+    -- waiting tasks by the ident of poll
+    local waiting = {}
+
+    for i, func in ipairs(funcs) do
+        local task = new_task(func)
+        task.id = i
+        tasks[i] = task
+        ready[#ready + 1] = task
+    end
+
+    local nactive = #tasks
+    while nactive > 0 do
+        -- resume the ready tasks
+        local pending = ready
+        ready = {}
+        for _, task in ipairs(pending) do
+            if not task.started then
+                task.started = true
+                handler.start(task)
+            end
+
+            if step(task, handler) then
+                nactive = nactive - 1
+                SCHEDULED[task.co] = nil
+                handler.finish(task)
+            elseif not task.kind then
+                ready[#ready + 1] = task
+            elseif task.kind ~= 'sleep' then
+                -- register the ident to poll
+                local ok, err
+                if waiting[task.ident] then
+                    err = format('%s is already waited by another test',
+                                 tostring(task.ident))
+                else
+                    p = p or assert(poll.new())
+                    if task.kind == 'exit' then
+                        ok, err = p:addproc(task.ident)
+                    else
+                        ok, err = p:add(task.ident, task.kind)
+                    end
+                end
+
+                if ok then
+                    waiting[task.ident] = task
+                else
+                    -- resume with error
+                    task.args = {
+                        nil,
+                        err,
+                    }
+                    task.kind = nil
+                    ready[#ready + 1] = task
+                end
+            end
+        end
+
+        if nactive > 0 and #ready == 0 then
+            -- find the nearest deadline
+            local now = monotime()
+            local snow = sleeptime()
+            local timeout, sdeadline
+            for _, task in ipairs(tasks) do
+                if task.kind and task.deadline then
+                    local sec
+                    if task.kind == 'sleep' then
+                        sec = task.deadline - snow
+                        if not sdeadline or task.deadline < sdeadline then
+                            sdeadline = task.deadline
+                        end
+                    else
+                        sec = task.deadline - now
+                    end
+                    if not timeout or sec < timeout then
+                        timeout = sec
+                    end
+                end
+            end
+            local virtual = sdeadline and timer.virtual()
+            if virtual then
+                -- the sleeping tasks do not wait in real time while the
+                -- virtual clock is enabled
+                timeout = 0
+            elseif timeout and timeout < 0 then
+                timeout = 0
+            end
+
+            -- wait for the events
+            if next(waiting) then
+                local evs = assert(p:wait(timeout))
+                for _, ev in ipairs(evs) do
+                    local task = waiting[ev.ident]
+                    if task then
+                        if task.kind == 'exit' then
+                            p:delproc(ev.ident)
+                        else
+                            p:del(ev.ident)
+                        end
+                        waiting[ev.ident] = nil
+                        task.kind = nil
+                        task.args = {
+                            true,
+                        }
+                        ready[#ready + 1] = task
+                    end
+                end
+            elseif timeout and timeout > 0 then
+                p = p or assert(poll.new())
+                assert(p:wait(timeout))
+            end
+
+            -- wake up the timed out tasks
+            now = monotime()
+            if virtual and #ready == 0 then
+                -- advance the virtual clock to the nearest sleep deadline
+                if sdeadline > snow then
+                    timer.advance(sdeadline - snow)
+                end
+                snow = sdeadline
+            end
+            snow = max(snow, sleeptime())
+            for _, task in ipairs(tasks) do
+                if task.kind and task.deadline and task.deadline <=
+                    (task.kind == 'sleep' and snow or now) then
+                    if task.kind == 'exit' then
+                        p:delproc(task.ident)
+                    elseif task.kind ~= 'sleep' then
+                        p:del(task.ident)
+                    end
+                    if waiting[task.ident] == task then
+                        waiting[task.ident] = nil
+                    end
+                    task.args = {
+                        task.kind == 'sleep',
+                    }
+                    task.kind = nil
+                    ready[#ready + 1] = task
+                end
+            end
+        end
+    end
+
+    if p then
+        p:close()
+    end
+end
+
+return {
+    is_scheduled = is_scheduled,
+    sleep = sleep,
+    readable = readable,
+    writable = writable,
+    wait = wait,
+    run = run,
+}
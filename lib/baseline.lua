@@ -0,0 +1,302 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local error = error
+local ipairs = ipairs
+local pairs = pairs
+local tonumber = tonumber
+local tostring = tostring
+local type = type
+local abs = math.abs
+local exp = math.exp
+local sqrt = math.sqrt
+local sort = table.sort
+local concat = table.concat
+local format = string.format
+local gmatch = string.gmatch
+local match = string.match
+local open = io.open
+local rename = os.rename
+local remove = os.remove
+--- constants
+local HEADER = '# testcase baseline v1'
+local DEFAULT_THRESHOLD = 5
+local DEFAULT_ALPHA = 0.05
+-- coefficients of the Chebyshev approximation of erfc
+local ERFC_COEF = {
+    -1.26551223,
+    1.00002368,
+    0.37409196,
+    0.09678418,
+    -0.18628806,
+    0.27886807,
+    -1.13520398,
+    1.48851587,
+    -0.82215223,
+    0.17087277,
+}
+
+--- save writes the elapsed time samples to the baseline file.
+--- the file is written to a temporary file and then renamed to the pathname.
+--- @param pathname string
+--- @param samples table<string, number[]>
+--- @return boolean ok
+--- @return string? err
+local function save(pathname, samples)
+    local names = {}
+    for name in pairs(samples) do
+        names[#names + 1] = name
+    end
+    sort(names)
+
+    local lines = {
+        HEADER,
+    }
+    for _, name in ipairs(names) do
+        local vals = {}
+        for i, v in ipairs(samples[name]) do
+            vals[i] = format('%.9g', v)
+        end
+        lines[#lines + 1] = name .. '\t' .. concat(vals, ' ')
+    end
+    lines[#lines + 1] = ''
+
+    local tmpname = pathname .. '.tmp'
+    local f, err = open(tmpname, 'w')
+    if not f then
+        return false, err
+    end
+    local ok
+    ok, err = f:write(concat(lines, '\n'))
+    f:close()
+    if ok then
+        ok, err = rename(tmpname, pathname)
+    end
+    if not ok then
+        remove(tmpname)
+        return false, err
+    end
+    return true
+end
+
+--- load reads the elapsed time samples from the baseline file
+--- @param pathname string
+--- @return table<string, number[]>? samples
+--- @return string? err
+local function load(pathname)
+    local f, err = open(pathname, 'r')
+    if not f then
+        return nil, err
+    end
+
+    local samples = {}
+    local lineno = 0
+    for line in f:lines() do
+        lineno = lineno + 1
+        if lineno == 1 then
+            if line ~= HEADER then
+                f:close()
+                return nil, format('%s:%d: unsupported baseline format',
+                                   pathname, lineno)
+            end
+        elseif line ~= '' then
+            local name, list = match(line, '^([^\t]+)\t(.+)$')
+            if not name then
+                f:close()
+                return nil, format('%s:%d: invalid line', pathname, lineno)
+            end
+
+            local vals = {}
+            for v in gmatch(list, '%S+') do
+                vals[#vals + 1] = tonumber(v)
+                if not vals[#vals] then
+                    f:close()
+                    return nil, format('%s:%d: invalid sample %q', pathname,
+                                       lineno, v)
+                end
+            end
+            samples[name] = vals
+        end
+    end
+    f:close()
+
+    return samples
+end
+
+--- median returns the median of the values
+--- @param vals number[]
+--- @return number
+local function median(vals)
+    local list = {}
+    for i, v in ipairs(vals) do
+        list[i] = v
+    end
+    sort(list)
+
+    local n = #list
+    if n % 2 == 1 then
+        return list[(n + 1) / 2]
+    end
+    return (list[n / 2] + list[n / 2 + 1]) / 2
+end
+
+--- erfc returns the complementary error function with fractional error less
+--- than 1.2e-7
+--- @param x number
+--- @return number
+local function erfc(x)
+    local z = abs(x)
+    local t = 1 / (1 + 0.5 * z)
+    local poly = 0
+    for i = #ERFC_COEF, 1, -1 do
+        poly = ERFC_COEF[i] + t * poly
+    end
+
+    local r = t * exp(-z * z + poly)
+    if x >= 0 then
+        return r
+    end
+    return 2 - r
+end
+
+--- mannwhitney performs the two-sided Mann-Whitney U test by the normal
+--- approximation with the tie and continuity corrections.
+--- @param x number[]
+--- @param y number[]
+--- @return number u the U statistic of x
+--- @return number p the p-value
+local function mannwhitney(x, y)
+    local n1, n2 = #x, #y
+    local list = {}
+    for _, v in ipairs(x) do
+        list[#list + 1] = {
+            v = v,
+            x = true,
+        }
+    end
+    for _, v in ipairs(y) do
+        list[#list + 1] = {
+            v = v,
+        }
+    end
+    sort(list, function(a, b)
+        return a.v < b.v
+    end)
+
+    -- assign the average rank to the tied values
+    local n = #list
+    local rx = 0
+    local ties = 0
+    local i = 1
+    while i <= n do
+        local j = i
+        while j < n and list[j + 1].v == list[i].v do
+            j = j + 1
+        end
+        local rank = (i + j) / 2
+        for k = i, j do
+            if list[k].x then
+                rx = rx + rank
+            end
+        end
+        local nt = j - i + 1
+        ties = ties + nt * nt * nt - nt
+        i = j + 1
+    end
+
+    local u = rx - n1 * (n1 + 1) / 2
+    local mu = n1 * n2 / 2
+    local sigma = sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))))
+    if sigma ~= sigma or sigma == 0 then
+        return u, 1
+    end
+
+    local z = abs(u - mu) - 0.5
+    if z < 0 then
+        z = 0
+    end
+    local p = erfc(z / sigma / sqrt(2))
+    if p > 1 then
+        p = 1
+    end
+    return u, p
+end
+
+--- compare compares the current samples with the baseline samples.
+--- a test case is reported as a regression if its median elapsed time is
+--- slower than the baseline by more than threshold percent, and the
+--- difference is significant at the alpha level.
+--- @param base table<string, number[]>
+--- @param cur table<string, number[]>
+--- @param threshold number? percentage (default: 5)
+--- @param alpha number? significance level (default: 0.05)
+--- @return table[] results
+local function compare(base, cur, threshold, alpha)
+    threshold = threshold or DEFAULT_THRESHOLD
+    alpha = alpha or DEFAULT_ALPHA
+    if type(threshold) ~= 'number' or threshold < 0 then
+        error(format('invalid argument #3 (unsigned number expected, got %s)',
+                     tostring(threshold)), 2)
+    elseif type(alpha) ~= 'number' or alpha <= 0 or alpha >= 1 then
+        error(format('invalid argument #4 (number between 0 and 1 expected, ' ..
+                         'got %s)', tostring(alpha)), 2)
+    end
+
+    local names = {}
+    for name in pairs(cur) do
+        if base[name] and #base[name] > 0 and #cur[name] > 0 then
+            names[#names + 1] = name
+        end
+    end
+    sort(names)
+
+    local results = {}
+    for _, name in ipairs(names) do
+        local bmed = median(base[name])
+        local cmed = median(cur[name])
+        local delta = 0
+        if bmed > 0 then
+            delta = (cmed - bmed) / bmed * 100
+        end
+        local _, p = mannwhitney(base[name], cur[name])
+        local significant = p < alpha
+        results[#results + 1] = {
+            name = name,
+            base = bmed,
+            cur = cmed,
+            delta = delta,
+            p = p,
+            significant = significant,
+            regression = significant and delta > threshold,
+        }
+    end
+
+    return results
+end
+
+return {
+    save = save,
+    load = load,
+    median = median,
+    mannwhitney = mannwhitney,
+    compare = compare,
+}
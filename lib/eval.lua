@@ -25,7 +25,6 @@ local error = error
 local loadfile = loadfile
 local open = io.open
 local pcall = pcall
-local traceback = debug.traceback
 local find = string.find
 local format = string.format
 local sub = string.sub
@@ -174,7 +173,7 @@ local function eval(filename)
     end
 
     -- luacheck: ignore err
-    local ok, err = xpcall(func, traceback)
+    local ok, err = xpcall(func)
     if not ok then
         return ok, err
     end
@@ -30,9 +30,11 @@ local fstat = require('testcase.fstat')
 local readdir = require('testcase.readdir')
 local realpath = require('testcase.realpath')
 local pchdir = require('testcase.chdir')
+local pmkdir = require('testcase.mkdir')
 local getcwd = require('testcase.getcwd')
 --- constants
 local ENOENT = require('errno').ENOENT
+local EEXIST = require('errno').EEXIST
 local CWD = assert(getcwd())
 
 --- trim_cwd remove CWD prefix from pathname
@@ -128,6 +130,30 @@ local function chdir(pathname)
     end
 end
 
+--- make a directory and its parent directories if they do not exist
+--- @param pathname string
+--- @return any error
+local function mkdir(pathname)
+    local ok, err = pmkdir(pathname)
+    if ok or err.type == EEXIST then
+        return
+    elseif err.type == ENOENT then
+        -- make the parent directory
+        local parent = match(pathname, '^(.+)/[^/]+/*$')
+        if parent then
+            err = mkdir(parent)
+            if err then
+                return err
+            end
+            ok, err = pmkdir(pathname)
+            if ok or err.type == EEXIST then
+                return
+            end
+        end
+    end
+    return err
+end
+
 --- cannonicalize filename
 --- @param pathname string
 --- @return table pathinfo
@@ -164,6 +190,7 @@ end
 
 return {
     chdir = chdir,
+    mkdir = mkdir,
     getfiles = getfiles,
     getstat = getstat,
 }
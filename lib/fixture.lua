@@ -0,0 +1,123 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local error = error
+local pcall = pcall
+local tostring = tostring
+local type = type
+local format = string.format
+local shm = require('testcase.shm')
+local record = require('testcase.record')
+-- shared fixtures by name
+local SHARED = {}
+-- decoded values of the shared fixtures in the current process
+local VALUES = {}
+
+--- shared returns the read-only shared memory of the fixture. the builder
+--- function is called only once by name, and the returned string is copied
+--- into the shared memory that is inherited by the forked child processes
+--- and used by the subsequent test files without rebuilding it. the shared
+--- memory is outside of the lua heap, so the garbage collector of the child
+--- processes never touches its pages.
+--- @param name string
+--- @param builder fun():string
+--- @return userdata testcase.shm
+local function shared(name, builder)
+    if type(name) ~= 'string' then
+        error(format('invalid argument #1 (string expected, got %s)',
+                     type(name)), 2)
+    end
+
+    local region = SHARED[name]
+    if region then
+        return region
+    elseif type(builder) ~= 'function' then
+        error(format('invalid argument #2 (function expected, got %s)',
+                     type(builder)), 2)
+    end
+
+    local data = builder()
+    if type(data) ~= 'string' then
+        error(format('fixture %q builder must return a string, got %s', name,
+                     type(data)), 2)
+    end
+    local err
+    region, err = shm(data)
+    if not region then
+        error(format('failed to create the shared memory of fixture %q: %s',
+                     name, tostring(err)), 2)
+    end
+    SHARED[name] = region
+    return region
+end
+
+--- value returns the table of the fixture. the builder function returns a
+--- table that can be encoded by testcase.record, and only the encoded bytes
+--- are shared as same as the shared function. the table is copied out of
+--- the shared memory and decoded into the lua heap once in each process
+--- that has not decoded it before the fork, and must be treated as
+--- read-only.
+--- @param name string
+--- @param builder fun():table
+--- @return table
+local function value(name, builder)
+    local v = VALUES[name]
+    if v then
+        return v
+    elseif type(name) ~= 'string' then
+        error(format('invalid argument #1 (string expected, got %s)',
+                     type(name)), 2)
+    end
+
+    local region = SHARED[name]
+    if not region then
+        if type(builder) ~= 'function' then
+            error(format('invalid argument #2 (function expected, got %s)',
+                         type(builder)), 2)
+        end
+        local ok, data = pcall(record.encode, builder())
+        if not ok then
+            error(format('failed to encode fixture %q: %s', name, data), 2)
+        end
+        region = shared(name, function()
+            return data
+        end)
+    end
+
+    v = record.decode(region:sub())
+    VALUES[name] = v
+    return v
+end
+
+--- release releases the fixture. the shared memory is unmapped when it is no
+--- longer referenced in the process.
+--- @param name string
+local function release(name)
+    SHARED[name] = nil
+    VALUES[name] = nil
+end
+
+return {
+    shared = shared,
+    value = value,
+    release = release,
+}
@@ -0,0 +1,523 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local assert = assert
+local error = error
+local ipairs = ipairs
+local pcall = pcall
+local tostring = tostring
+local type = type
+local xpcall = xpcall
+local unpack = unpack or table.unpack
+local floor = math.floor
+local random = math.random
+local randomseed = math.randomseed
+local byte = string.byte
+local char = string.char
+local find = string.find
+local format = string.format
+local rep = string.rep
+local sub = string.sub
+local gethook = debug.gethook
+local getinfo = debug.getinfo
+local sethook = debug.sethook
+local traceback = debug.traceback
+local open = io.open
+local ostime = os.time
+local exit = require('testcase.exit').exit
+local fork = require('testcase.fork')
+local mkdir = require('testcase.filesystem').mkdir
+local readdir = require('testcase.readdir')
+local socketpair = require('testcase.socketpair')
+local record = require('testcase.record')
+local trace = require('testcase.trace')
+local timer = require('testcase.timer')
+--- constants
+-- the maximum number of executions to minimize the failing input
+local MAX_MINIMIZE = 10000
+-- the tokens that often trigger the edge cases of parsers
+local TOKENS = {
+    '\0',
+    '\255',
+    '\127',
+    '\r\n',
+    '-1',
+    '0',
+    '4294967296',
+    '1e309',
+    '%s',
+    '"',
+    "'",
+    '\\',
+    '{',
+    '}',
+    '[',
+    ']',
+    '<',
+    '>',
+    rep('A', 256),
+}
+
+-- OPTIONS = {
+--     -- number of executions of each fuzz target
+--     runs = <number>,
+--     -- seed of the random number generator. os.time() is used if nil.
+--     seed = <number?>,
+--     -- directory to keep the interesting and crashing inputs of each target
+--     corpus = <string?>,
+--     -- number of the forked worker processes
+--     workers = <number>,
+--     -- maximum length of the generated inputs
+--     maxlen = <number>,
+--     -- keep the inputs that reach the new lines as interesting inputs. it
+--     -- runs the target with the line hook, so it is disabled by default.
+--     coverage = <boolean>,
+-- }
+local OPTIONS = {
+    runs = 10000,
+    workers = 1,
+    maxlen = 4096,
+    coverage = false,
+}
+
+--- is_uint returns v if v is an integer greater than min
+--- @param v any
+--- @param min number
+--- @return integer? v
+--- @return string? err
+local function is_uint(v, min)
+    if type(v) ~= 'number' or v ~= v or v % 1 ~= 0 or v < min then
+        return nil, format('integer greater than %d expected, got %s',
+                           min - 1, tostring(v))
+    end
+    return v
+end
+
+local VALIDATE_OPTION = {
+    runs = function(v)
+        return is_uint(v, 1)
+    end,
+    seed = function(v)
+        if v == nil then
+            return nil
+        end
+        return is_uint(v, 0)
+    end,
+    corpus = function(v)
+        if v ~= nil and type(v) ~= 'string' then
+            return nil, format('string expected, got %s', type(v))
+        end
+        return v
+    end,
+    workers = function(v)
+        return is_uint(v, 1)
+    end,
+    maxlen = function(v)
+        return is_uint(v, 1)
+    end,
+    coverage = function(v)
+        if type(v) ~= 'boolean' then
+            return nil, format('boolean expected, got %s', type(v))
+        end
+        return v
+    end,
+}
+
+--- setopt sets the value of fuzz option
+--- @param name string
+--- @param val any
+local function setopt(name, val)
+    local validate = VALIDATE_OPTION[name]
+    if not validate then
+        error(format('unknown option %q', tostring(name)), 2)
+    end
+
+    local v, err = validate(val)
+    if err then
+        error(format('invalid %s option: %s', name, err), 2)
+    end
+    OPTIONS[name] = v
+end
+
+--- hash returns the djb2 hash of the string
+--- @param s string
+--- @return integer
+local function hash(s)
+    local h = 5381
+    for i = 1, #s do
+        h = (h * 33 + byte(s, i)) % 4294967296
+    end
+    return h
+end
+
+--- randstr returns a random string
+--- @param len integer
+--- @return string
+local function randstr(len)
+    local arr = {}
+    for i = 1, len do
+        arr[i] = random(0, 255)
+    end
+    return char(unpack(arr))
+end
+
+--- mutate returns a new input generated from the input
+--- @param input string
+--- @param corpus string[]
+--- @return string
+local function mutate(input, corpus)
+    for _ = 1, random(1, 4) do
+        local len = #input
+        local pos = random(1, len + 1)
+        local op = random(1, 6)
+        if op == 1 and len > 0 then
+            -- replace a byte
+            input = sub(input, 1, pos - 1) .. randstr(1) .. sub(input, pos + 1)
+        elseif op == 2 then
+            -- insert the random bytes
+            input = sub(input, 1, pos - 1) .. randstr(random(1, 8)) ..
+                        sub(input, pos)
+        elseif op == 3 and len > 0 then
+            -- delete the bytes
+            input = sub(input, 1, pos - 1) .. sub(input, pos + random(1, 8))
+        elseif op == 4 and len > 0 then
+            -- duplicate the bytes
+            local chunk = sub(input, pos, pos + random(1, 16) - 1)
+            input = sub(input, 1, pos - 1) .. chunk .. sub(input, pos)
+        elseif op == 5 then
+            -- insert the token
+            input = sub(input, 1, pos - 1) .. TOKENS[random(1, #TOKENS)] ..
+                        sub(input, pos)
+        else
+            -- splice with another input
+            local other = corpus[random(1, #corpus)]
+            input = sub(input, 1, pos - 1) ..
+                        sub(other, random(1, #other + 1))
+        end
+    end
+
+    if #input > OPTIONS.maxlen then
+        return sub(input, 1, OPTIONS.maxlen)
+    end
+    return input
+end
+
+-- lines reached by the target
+local COVERED = {}
+-- true if the target reached a new line in the current execution
+local NEWCOV = false
+
+local function linehook(_, line)
+    local src = getinfo(2, 'S').source
+    local lines = COVERED[src]
+    if not lines then
+        lines = {}
+        COVERED[src] = lines
+    end
+    if not lines[line] then
+        lines[line] = true
+        NEWCOV = true
+    end
+end
+
+--- exec calls the target with the input
+--- @param target function
+--- @param input string
+--- @return boolean ok
+--- @return boolean newcov
+local function exec(target, input)
+    if not OPTIONS.coverage then
+        return pcall(target, input), false
+    end
+
+    -- restore the hook of others (e.g. luacov) after the execution
+    local hookfn, mask, count = gethook()
+    NEWCOV = false
+    sethook(linehook, 'l')
+    local ok = pcall(target, input)
+    if hookfn then
+        sethook(hookfn, mask, count)
+    else
+        sethook()
+    end
+    return ok, NEWCOV
+end
+
+--- minimize returns the shortest input that still fails, found by removing
+--- the chunks of the input.
+--- @param target function
+--- @param input string
+--- @return string input
+local function minimize(target, input)
+    local nexec = 0
+    local chunk = floor(#input / 2)
+    while chunk >= 1 and nexec < MAX_MINIMIZE do
+        local reduced = false
+        local i = 1
+        while i <= #input and nexec < MAX_MINIMIZE do
+            local v = sub(input, 1, i - 1) .. sub(input, i + chunk)
+            nexec = nexec + 1
+            if not pcall(target, v) then
+                input = v
+                reduced = true
+            else
+                i = i + chunk
+            end
+        end
+        if not reduced then
+            chunk = floor(chunk / 2)
+        end
+    end
+    return input
+end
+
+--- writefile writes the input to the corpus directory
+--- @param dirname string?
+--- @param prefix string
+--- @param input string
+--- @return string? pathname
+local function writefile(dirname, prefix, input)
+    if not dirname then
+        return
+    end
+
+    local pathname = format('%s/%s%08x', dirname, prefix, hash(input))
+    local f = open(pathname, 'wb')
+    if f then
+        f:write(input)
+        f:close()
+        return pathname
+    end
+end
+
+--- loadcorpus loads the inputs in the corpus directory
+--- @param dirname string?
+--- @return string[] corpus
+--- @return string[] crashes the inputs that caused the failures before
+local function loadcorpus(dirname)
+    local corpus = {
+        '',
+    }
+    local crashes = {}
+    if not dirname then
+        return corpus, crashes
+    end
+
+    local err = mkdir(dirname)
+    if err then
+        error(format('failed to make the corpus directory %q: %s', dirname,
+                     tostring(err)), 0)
+    end
+    err = readdir(dirname, function(entry)
+        if find(entry, '^%.') then
+            return
+        end
+        local f = open(dirname .. '/' .. entry, 'rb')
+        if f then
+            local input = f:read('*a') or ''
+            f:close()
+            if find(entry, '^crash%-') then
+                crashes[#crashes + 1] = input
+            else
+                corpus[#corpus + 1] = input
+            end
+        end
+    end)
+    if err then
+        error(format('failed to read the corpus directory %q: %s', dirname,
+                     tostring(err)), 0)
+    end
+    return corpus, crashes
+end
+
+--- fuzzloop executes the target with the mutated inputs
+--- @param target function
+--- @param corpus string[]
+--- @param dirname string?
+--- @param nrun integer
+--- @return integer nexec
+--- @return string? crash the input that caused the failure
+local function fuzzloop(target, corpus, dirname, nrun)
+    for i = 1, nrun do
+        local input = mutate(corpus[random(1, #corpus)], corpus)
+        local ok, newcov = exec(target, input)
+        if not ok then
+            return i, input
+        elseif newcov then
+            corpus[#corpus + 1] = input
+            writefile(dirname, '', input)
+        end
+    end
+    return nrun
+end
+
+--- exitstatus returns the description of the abnormal exit of the worker
+--- @param res table? result of proc:wait()
+--- @param err any
+--- @return string? msg
+local function exitstatus(res, err)
+    if not res then
+        return format('failed to wait: %s', tostring(err))
+    elseif res.sigterm then
+        return format('terminated by signal %d', res.sigterm)
+    elseif res.exit ~= 0 and res.exit ~= 1 then
+        return format('exited with status %s', tostring(res.exit))
+    end
+end
+
+--- runworkers runs the fuzzloop in the forked worker processes
+--- @param target function
+--- @param corpus string[]
+--- @param dirname string?
+--- @param seed integer
+--- @return integer nexec
+--- @return string? crash
+--- @return integer? crashseed seed of the worker that found the crash
+--- @return string? abort the worker that exited without the result
+local function runworkers(target, corpus, dirname, seed)
+    local nworker = OPTIONS.workers
+    local workers = {}
+    for i = 1, nworker do
+        local nrun = floor(OPTIONS.runs / nworker)
+        if i <= OPTIONS.runs % nworker then
+            nrun = nrun + 1
+        end
+
+        local s1, s2 = assert(socketpair())
+        local proc, err = fork()
+        if not proc then
+            error(format('failed to fork the worker: %s', tostring(err)), 0)
+        elseif proc:is_child() then
+            -- worker process sends the result to the parent and exits
+            s1:close()
+            randomseed(seed + i - 1)
+            local span = trace.begin(format('worker #%d', i), 'fuzz')
+            local nexec, crash = fuzzloop(target, corpus, dirname, nrun)
+            trace.finish(span, {
+                nexec = nexec,
+            })
+            s2:write(record.encode({
+                nexec = nexec,
+                crash = crash,
+            }))
+            s2:close()
+            exit(crash and 1 or 0)
+        end
+        s2:close()
+        workers[i] = {
+            proc = proc,
+            sock = s1,
+        }
+    end
+
+    local nexec = 0
+    local crash, crashseed, abort
+    for i, w in ipairs(workers) do
+        local msg = w.sock:readall() or ''
+        w.sock:close()
+        local res = record.decode(msg)
+        local status = exitstatus(w.proc:wait())
+        if res then
+            nexec = nexec + res.nexec
+        end
+        if not res or status then
+            -- the worker was aborted by the target (e.g. a segfault or the
+            -- exit of the process) before sending the result
+            abort = abort or
+                        format('fuzz worker #%d %s without the result ' ..
+                                   '(seed: %d)', i, status or 'exited',
+                               seed + i - 1)
+        elseif res.crash and not crash then
+            crash, crashseed = res.crash, seed + i - 1
+        end
+    end
+    return nexec, crash, crashseed, abort
+end
+
+--- run executes the fuzz target with the generated inputs
+--- @param name string
+--- @param target function
+--- @return integer nexec number of the executions of the target
+local function run(name, target)
+    local seed = OPTIONS.seed or ostime()
+    local dirname = OPTIONS.corpus and OPTIONS.corpus .. '/' .. name
+    local corpus, crashes = loadcorpus(dirname)
+    COVERED = {}
+
+    -- replay the inputs that caused the failures before
+    local crash
+    for _, input in ipairs(crashes) do
+        if not pcall(target, input) then
+            crash = input
+            break
+        end
+    end
+    -- replay the corpus to collect the coverage
+    if OPTIONS.coverage then
+        for _, input in ipairs(corpus) do
+            exec(target, input)
+        end
+    end
+
+    -- the replays above are not counted as the executions
+    local nexec = 0
+    local crashseed, abort
+    local t = timer.clock()
+    if not crash then
+        if OPTIONS.workers > 1 then
+            nexec, crash, crashseed, abort = runworkers(target, corpus,
+                                                        dirname, seed)
+        else
+            randomseed(seed)
+            nexec, crash = fuzzloop(target, corpus, dirname, OPTIONS.runs)
+            crashseed = seed
+        end
+    end
+    local elapsed = (timer.clock() - t) / 1e9
+
+    print(format('%d execs in %.3f s (%d execs/s), corpus: %d, seed: %d, ' ..
+                     'workers: %d', nexec, elapsed,
+                 elapsed > 0 and floor(nexec / elapsed) or 0, #corpus, seed,
+                 OPTIONS.workers))
+    if abort then
+        error(abort, 0)
+    elseif not crash then
+        return nexec
+    end
+
+    crash = minimize(target, crash)
+    local pathname = writefile(dirname, 'crash-', crash)
+    local _, err = xpcall(function()
+        target(crash)
+    end, traceback)
+    error(format('fuzz target failed with input %q (seed: %d%s)\n%s', crash,
+                 crashseed or seed,
+                 pathname and ', saved to ' .. pathname or '', tostring(err)),
+          0)
+end
+
+return {
+    setopt = setopt,
+    mutate = mutate,
+    minimize = minimize,
+    run = run,
+}
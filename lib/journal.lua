@@ -0,0 +1,155 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local setmetatable = setmetatable
+local tostring = tostring
+local open = io.open
+local rename = os.rename
+local remove = os.remove
+local sub = string.sub
+local fsync = require('testcase.fsync')
+local record = require('testcase.record')
+--- constants
+-- number of the test events written between the fsync calls
+local SYNC_INTERVAL = 16
+
+--- @class testcase.journal
+--- @field file file*
+--- @field nwrite integer number of the test events after the last fsync
+local Journal = {}
+Journal.__index = Journal
+
+--- sync flushes the written events to the storage
+--- @return boolean ok
+--- @return any err
+function Journal:sync()
+    self.nwrite = 0
+    return fsync(self.file)
+end
+
+--- write appends the event of the runner to the journal. the journal is
+--- synchronized to the storage every SYNC_INTERVAL test events and at the
+--- end of each test file, so a crash loses at most those recent events.
+--- @param event table
+--- @return boolean ok
+--- @return any err
+function Journal:write(event)
+    local ok, err = self.file:write(record.encode(event))
+    if not ok then
+        return false, err
+    elseif event.event == 'test' then
+        self.nwrite = self.nwrite + 1
+        if self.nwrite < SYNC_INTERVAL then
+            return true
+        end
+    elseif event.event ~= 'done' then
+        return true
+    end
+    return self:sync()
+end
+
+--- close synchronizes and closes the journal
+--- @return boolean ok
+--- @return any err
+function Journal:close()
+    local ok, err = self:sync()
+    self.file:close()
+    return ok, err
+end
+
+--- new opens the journal file. the file is truncated unless append is true.
+--- @param pathname string
+--- @param append boolean?
+--- @return testcase.journal? journal
+--- @return string? err
+local function new(pathname, append)
+    local f, err = open(pathname, append and 'ab' or 'wb')
+    if not f then
+        return nil, err
+    end
+    f:setvbuf('full')
+    return setmetatable({
+        file = f,
+        nwrite = 0,
+    }, Journal)
+end
+
+--- load reads the journal file and returns the last event of each test case
+--- that succeeded, keyed by `file:testname`. the truncated or malformed
+--- records at the tail of the journal, written by a crashed run, are
+--- discarded and the file is rewritten with the valid records so that the
+--- next run can append to it.
+--- @param pathname string
+--- @return table<string, table>? passed
+--- @return string? err
+local function load(pathname)
+    local f, err = open(pathname, 'rb')
+    if not f then
+        return nil, err
+    end
+    local data = f:read('*a') or ''
+    f:close()
+
+    local passed = {}
+    local pos = 1
+    while pos <= #data do
+        local event, nextpos = record.decode(data, pos)
+        if not event then
+            break
+        end
+        pos = nextpos
+
+        if event.event == 'test' then
+            local id = event.file .. ':' .. event.name
+            passed[id] = event.ok and event or nil
+        end
+    end
+
+    if pos <= #data then
+        -- discard the broken tail
+        local tmpname = pathname .. '.tmp'
+        local ok
+        f, err = open(tmpname, 'wb')
+        if not f then
+            return nil, err
+        end
+        ok, err = f:write(sub(data, 1, pos - 1))
+        if ok then
+            ok, err = fsync(f)
+        end
+        f:close()
+        if ok then
+            ok, err = rename(tmpname, pathname)
+        end
+        if not ok then
+            remove(tmpname)
+            return nil, tostring(err)
+        end
+    end
+
+    return passed
+end
+
+return {
+    new = new,
+    load = load,
+}
@@ -0,0 +1,278 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local assert = assert
+local error = error
+local ipairs = ipairs
+local pcall = pcall
+local tostring = tostring
+local type = type
+local ceil = math.ceil
+local floor = math.floor
+local sort = table.sort
+local format = string.format
+local exit = require('testcase.exit').exit
+local fork = require('testcase.fork')
+local socketpair = require('testcase.socketpair')
+local record = require('testcase.record')
+local trace = require('testcase.trace')
+local timer = require('testcase.timer')
+--- constants
+local PERCENTILES = {
+    50,
+    90,
+    99,
+}
+-- summaries of the load tests in this process
+local RESULTS = {}
+
+--- fmtns formats the nanoseconds with the time unit
+--- @param ns number
+--- @return string
+local function fmtns(ns)
+    local v, fmt = timer.format(ns)
+    return format(fmt, v)
+end
+
+--- worker calls the target repeatedly and returns the result encoded by
+--- testcase.record. the latency of each request is in nanoseconds.
+--- @param target function
+--- @param nreq integer?
+--- @param duration number?
+--- @return string result
+local function worker(target, nreq, duration)
+    local samples = {}
+    local nerr = 0
+    local errmsg
+    local clock = timer.clock
+    local start = clock()
+    local deadline = duration and start + duration * 1e9
+    local i = 0
+
+    while true do
+        if nreq then
+            if i >= nreq then
+                break
+            end
+        elseif clock() >= deadline then
+            break
+        end
+        i = i + 1
+
+        local t = clock()
+        local ok, err = pcall(target, i)
+        samples[i] = clock() - t
+        if not ok then
+            nerr = nerr + 1
+            errmsg = errmsg or tostring(err)
+        end
+    end
+
+    return record.encode({
+        nreq = i,
+        nerr = nerr,
+        elapsed = clock() - start,
+        errmsg = errmsg,
+        samples = samples,
+    })
+end
+
+--- percentile returns the value of the nearest rank
+--- @param sorted number[]
+--- @param p number
+--- @return number
+local function percentile(sorted, p)
+    local n = #sorted
+    if n == 0 then
+        return 0
+    end
+    local rank = ceil(p / 100 * n)
+    if rank < 1 then
+        rank = 1
+    end
+    return sorted[rank]
+end
+
+--- summarize returns the summary of the latency samples
+--- @param name string
+--- @param nworker integer
+--- @param results table[]
+--- @return table summary
+local function summarize(name, nworker, results)
+    local samples = {}
+    local nreq = 0
+    local nerr = 0
+    local elapsed = 0
+    local errmsg
+    for _, res in ipairs(results) do
+        nreq = nreq + res.nreq
+        nerr = nerr + res.nerr
+        errmsg = errmsg or res.errmsg
+        -- workers run in parallel, so use the longest one as the elapsed time
+        if res.elapsed > elapsed then
+            elapsed = res.elapsed
+        end
+        for _, v in ipairs(res.samples) do
+            samples[#samples + 1] = v
+        end
+    end
+    sort(samples)
+
+    local sum = 0
+    for _, v in ipairs(samples) do
+        sum = sum + v
+    end
+
+    local summary = {
+        name = name,
+        workers = nworker,
+        requests = nreq,
+        errors = nerr,
+        error = errmsg,
+        elapsed = elapsed / 1e9,
+        throughput = elapsed > 0 and nreq / (elapsed / 1e9) or 0,
+        min = samples[1] or 0,
+        max = samples[#samples] or 0,
+        mean = #samples > 0 and sum / #samples or 0,
+    }
+    for _, p in ipairs(PERCENTILES) do
+        summary['p' .. p] = percentile(samples, p)
+    end
+    return summary
+end
+
+--- tostr returns the summary as a string
+--- @param s table
+--- @return string
+local function tostr(s)
+    return format('%s: %d workers, %d requests (%d errors) in %.3f s, ' ..
+                      '%.1f req/s, latency min/mean/p50/p90/p99/max: ' ..
+                      '%s/%s/%s/%s/%s/%s', s.name, s.workers, s.requests,
+                  s.errors, s.elapsed, s.throughput, fmtns(s.min),
+                  fmtns(s.mean), fmtns(s.p50), fmtns(s.p90), fmtns(s.p99),
+                  fmtns(s.max))
+end
+
+--- run calls the target from the forked workers for a fixed number of
+--- requests or a fixed duration, and returns the summary of the throughput
+--- and the latency. the target is called with the sequence number of the
+--- request in each worker.
+--- @param name string
+--- @param target function
+--- @param opts table?
+---  workers: number of the worker processes (default: 1)
+---  requests: total number of the requests
+---  duration: seconds to run each worker (default: 1 if requests is nil)
+--- @return table summary
+local function run(name, target, opts)
+    opts = opts or {}
+    if type(name) ~= 'string' then
+        error(format('invalid argument #1 (string expected, got %s)',
+                     type(name)), 2)
+    elseif type(target) ~= 'function' then
+        error(format('invalid argument #2 (function expected, got %s)',
+                     type(target)), 2)
+    elseif type(opts) ~= 'table' then
+        error(format('invalid argument #3 (table expected, got %s)',
+                     type(opts)), 2)
+    end
+
+    local nworker = opts.workers or 1
+    local nreq = opts.requests
+    local duration = opts.duration
+    if type(nworker) ~= 'number' or nworker < 1 or nworker % 1 ~= 0 then
+        error('invalid opts.workers (positive integer expected)', 2)
+    elseif nreq ~= nil and
+        (type(nreq) ~= 'number' or nreq < 1 or nreq % 1 ~= 0) then
+        error('invalid opts.requests (positive integer expected)', 2)
+    elseif duration ~= nil and
+        (type(duration) ~= 'number' or duration <= 0) then
+        error('invalid opts.duration (positive number expected)', 2)
+    elseif nreq and duration then
+        error('opts.requests and opts.duration cannot be used together', 2)
+    elseif not nreq then
+        duration = duration or 1
+    end
+
+    -- start the workers
+    local workers = {}
+    for i = 1, nworker do
+        local n
+        if nreq then
+            n = floor(nreq / nworker)
+            if i <= nreq % nworker then
+                n = n + 1
+            end
+        end
+
+        local s1, s2 = assert(socketpair())
+        local proc, err = fork()
+        if not proc then
+            error(format('failed to fork the worker: %s', tostring(err)), 2)
+        elseif proc:is_child() then
+            -- worker process sends the result to the parent and exits
+            s1:close()
+            local span = trace.begin(format('%s #%d', name, i), 'load')
+            local res = worker(target, n, duration)
+            trace.finish(span)
+            s2:write(res)
+            s2:close()
+            exit(0)
+        end
+        s2:close()
+        workers[i] = {
+            proc = proc,
+            sock = s1,
+        }
+    end
+
+    -- collect the results of the workers
+    local results = {}
+    for i, w in ipairs(workers) do
+        local msg = w.sock:readall() or ''
+        w.sock:close()
+        w.proc:wait()
+
+        local res = record.decode(msg)
+        if not res then
+            error(format('worker #%d exited without the result', i), 2)
+        end
+        results[i] = res
+    end
+
+    local summary = summarize(name, nworker, results)
+    RESULTS[#RESULTS + 1] = summary
+    print(tostr(summary))
+    return summary
+end
+
+--- results returns the summaries of the load tests that have been run
+--- @return table[] summaries
+local function results()
+    return RESULTS
+end
+
+return {
+    run = run,
+    results = results,
+    tostring = tostr,
+}
@@ -0,0 +1,237 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local ipairs = ipairs
+local tostring = tostring
+local ceil = math.ceil
+local concat = table.concat
+local sort = table.sort
+local format = string.format
+local gsub = string.gsub
+local open = io.open
+local rename = os.rename
+local remove = os.remove
+--- constants
+local QUANTILES = {
+    0.5,
+    0.9,
+    0.99,
+}
+local DURATION = 'testcase_test_duration_seconds'
+local INSTRUCTIONS = 'testcase_test_instructions'
+local CCALLS = 'testcase_test_ccalls'
+local LABEL_ESCAPES = {
+    ['\\'] = '\\\\',
+    ['"'] = '\\"',
+    ['\n'] = '\\n',
+}
+
+--- labels returns the label set of the metric
+--- @param ... string pairs of the label name and value
+--- @return string
+local function labels(...)
+    local list = {}
+    local args = {
+        ...,
+    }
+    for i = 1, #args, 2 do
+        local v = gsub(tostring(args[i + 1]), '[\\"\n]', LABEL_ESCAPES)
+        list[#list + 1] = format('%s="%s"', args[i], v)
+    end
+    return '{' .. concat(list, ',') .. '}'
+end
+
+--- quantile returns the value of the nearest rank
+--- @param sorted number[]
+--- @param q number
+--- @return number
+local function quantile(sorted, q)
+    local rank = ceil(q * #sorted)
+    if rank < 1 then
+        rank = 1
+    end
+    return sorted[rank]
+end
+
+--- collect aggregates the events of the runner by the test file
+--- @param events table[]
+--- @return table[] files
+local function collect(events)
+    local files = {}
+    local cur
+    for _, event in ipairs(events) do
+        if event.event == 'file' then
+            cur = {
+                name = event.file,
+                nsuccess = 0,
+                nfailure = 0,
+                tests = {},
+            }
+            files[#files + 1] = cur
+        elseif event.event == 'test' and cur then
+            cur.tests[#cur.tests + 1] = event
+        elseif event.event == 'done' and cur then
+            cur.nsuccess = event.nsuccess
+            cur.nfailure = event.nfailure
+        end
+    end
+    return files
+end
+
+--- write writes the metrics of the run to the file in the OpenMetrics text
+--- format. the counts are gauges since each run rewrites the file. the file
+--- is written to a temporary file and then renamed to the pathname so that
+--- the collector never reads the partially written file.
+--- the summary table must have the following fields;
+---  nsuccess: number of the successful test cases
+---  nfailure: number of the failed test cases
+---  nloadfailure: number of the test files that failed to load
+---  total: total elapsed time of the test cases in nanoseconds
+--- @param pathname string
+--- @param events table[] events received by runner.listen
+--- @param summary table
+--- @return boolean ok
+--- @return string? err
+local function write(pathname, events, summary)
+    local files = collect(events)
+    local lines = {
+        '# HELP testcase_tests Number of the test cases by result.',
+        '# TYPE testcase_tests gauge',
+        format('testcase_tests%s %d', labels('result', 'success'),
+               summary.nsuccess),
+        format('testcase_tests%s %d', labels('result', 'failure'),
+               summary.nfailure),
+        '# HELP testcase_load_failures Number of the test files that ' ..
+            'failed to load.',
+        '# TYPE testcase_load_failures gauge',
+        format('testcase_load_failures %d', summary.nloadfailure),
+        '# HELP testcase_duration_seconds Total elapsed time of the test ' ..
+            'cases.',
+        '# TYPE testcase_duration_seconds gauge',
+        format('testcase_duration_seconds %.9f', summary.total / 1e9),
+        '# HELP testcase_file_tests Number of the test cases by file and ' ..
+            'result.',
+        '# TYPE testcase_file_tests gauge',
+    }
+    for _, file in ipairs(files) do
+        lines[#lines + 1] = format('testcase_file_tests%s %d',
+                                   labels('file', file.name, 'result',
+                                          'success'), file.nsuccess)
+        lines[#lines + 1] = format('testcase_file_tests%s %d',
+                                   labels('file', file.name, 'result',
+                                          'failure'), file.nfailure)
+    end
+
+    lines[#lines + 1] = '# HELP testcase_test_success 1 if the test case ' ..
+                            'succeeded, 0 otherwise.'
+    lines[#lines + 1] = '# TYPE testcase_test_success gauge'
+    for _, file in ipairs(files) do
+        for _, test in ipairs(file.tests) do
+            lines[#lines + 1] = format('testcase_test_success%s %d',
+                                       labels('file', file.name, 'test',
+                                              test.name), test.ok and 1 or 0)
+        end
+    end
+
+    lines[#lines + 1] = '# HELP ' .. DURATION .. ' Elapsed time of the ' ..
+                            'test case.'
+    lines[#lines + 1] = '# TYPE ' .. DURATION .. ' summary'
+    for _, file in ipairs(files) do
+        for _, test in ipairs(file.tests) do
+            -- the repeated samples are used if the samples option is set
+            local samples = test.samples or {
+                test.elapsed / 1e9,
+            }
+            local sorted = {}
+            local sum = 0
+            for i, v in ipairs(samples) do
+                sorted[i] = v
+                sum = sum + v
+            end
+            sort(sorted)
+            if #sorted > 1 then
+                for _, q in ipairs(QUANTILES) do
+                    lines[#lines + 1] = format('%s%s %.9f', DURATION,
+                                               labels('file', file.name,
+                                                      'test', test.name,
+                                                      'quantile', q),
+                                               quantile(sorted, q))
+                end
+            end
+            local lbl = labels('file', file.name, 'test', test.name)
+            lines[#lines + 1] = format('%s_sum%s %.9f', DURATION, lbl, sum)
+            lines[#lines + 1] = format('%s_count%s %d', DURATION, lbl,
+                                       #sorted)
+        end
+    end
+
+    -- the instruction counts are written if the icount option is set
+    local counted = {}
+    for _, file in ipairs(files) do
+        for _, test in ipairs(file.tests) do
+            if test.instructions then
+                local lbl = labels('file', file.name, 'test', test.name)
+                counted[#counted + 1] = format('%s%s %d', INSTRUCTIONS, lbl,
+                                               test.instructions)
+                counted[#counted + 1] = format('%s%s %d', CCALLS, lbl,
+                                               test.ccalls)
+            end
+        end
+    end
+    if #counted > 0 then
+        lines[#lines + 1] = '# HELP ' .. INSTRUCTIONS .. ' Number of the VM ' ..
+                                'instructions executed by the test case.'
+        lines[#lines + 1] = '# TYPE ' .. INSTRUCTIONS .. ' gauge'
+        for i = 1, #counted, 2 do
+            lines[#lines + 1] = counted[i]
+        end
+        lines[#lines + 1] = '# HELP ' .. CCALLS .. ' Number of the C ' ..
+                                'function calls of the test case.'
+        lines[#lines + 1] = '# TYPE ' .. CCALLS .. ' gauge'
+        for i = 2, #counted, 2 do
+            lines[#lines + 1] = counted[i]
+        end
+    end
+    lines[#lines + 1] = '# EOF'
+    lines[#lines + 1] = ''
+
+    local tmpname = pathname .. '.tmp'
+    local f, err = open(tmpname, 'w')
+    if not f then
+        return false, err
+    end
+    local ok
+    ok, err = f:write(concat(lines, '\n'))
+    f:close()
+    if ok then
+        ok, err = rename(tmpname, pathname)
+    end
+    if not ok then
+        remove(tmpname)
+        return false, err
+    end
+    return true
+end
+
+return {
+    write = write,
+}
@@ -35,6 +35,7 @@ local format = string.format
 local select_len = require('testcase.select').len
 local select_head = require('testcase.select').head
 local select_tail = require('testcase.select').tail
+local timefmt = require('testcase.timer').format
 -- constants
 local NEWLINE = '\r?\n'
 
@@ -171,8 +172,17 @@ local function new(prefix, suffix, doformat)
     })
 end
 
+--- fmtsec formats the seconds with the time unit of testcase.timer
+--- @param sec number
+--- @return string
+local function fmtsec(sec)
+    local v, fmt = timefmt(sec * 1e9)
+    return format(fmt, v)
+end
+
 return {
     new = new,
     parse_format = parse_format,
     vstringify = vstringify,
+    fmtsec = fmtsec,
 }
@@ -21,7 +21,13 @@
 --
 local type = type
 local pairs = pairs
+local ipairs = ipairs
+local pcall = pcall
+local tostring = tostring
+local tonumber = tonumber
 local sort = table.sort
+local find = string.find
+local sub = string.sub
 local getinfo = debug.getinfo
 local format = string.format
 local trim_prefix = require('testcase.trim').prefix
@@ -44,11 +50,28 @@ end
 --                 name = <string>,
 --                 func = <function>,
 --                 lineno = <number>,
+--                 async = <boolean?>,
+--                 fuzz = <boolean?>,
 --             }
---         }
+--         },
+--         limits = {
+--             [<func_name:string>] = <table>,
+--         },
 --     }
 -- }
 local REGISTRY = {}
+-- FILTER = {
+--     run = <pattern:string>,
+--     skip = <pattern:string>,
+-- }
+local FILTER = {}
+-- EXCLUDE = {
+--     [<srcfile:testname>] = true,
+-- }
+local EXCLUDE
+-- the excluded test cases that are registered and not filtered out by the
+-- patterns
+local EXCLUDED = {}
 local SETUP_AND_TEARDOWN = {
     before_all = true,
     after_all = true,
@@ -56,12 +79,166 @@ local SETUP_AND_TEARDOWN = {
     after_each = true,
 }
 
---- getlist returns a list of registered test cases
+--- is_filtered returns true if the test case should not be run
+--- @param src string
+--- @param name string
+--- @return boolean
+local function is_filtered(src, name)
+    local id = src .. ':' .. name
+    if FILTER.run and not find(id, FILTER.run) then
+        return true
+    elseif FILTER.skip and find(id, FILTER.skip) then
+        return true
+    elseif EXCLUDE and EXCLUDE[id] then
+        EXCLUDED[id] = true
+        return true
+    end
+    return false
+end
+
+--- setend returns the position after the end of the set that starts at i
+--- @param pattern string
+--- @param i integer position of '['
+--- @return integer? pos
+local function setend(pattern, i)
+    local j = i + 1
+    if sub(pattern, j, j) == '^' then
+        j = j + 1
+    end
+    -- the first character of the set can be ']'
+    repeat
+        if j > #pattern then
+            return nil
+        elseif sub(pattern, j, j) == '%' then
+            j = j + 1
+        end
+        j = j + 1
+    until sub(pattern, j, j) == ']'
+    return j + 1
+end
+
+--- checkpattern checks the syntax of the whole pattern. string.find reports
+--- the malformed part only when the matching reaches it, so it does not
+--- detect the error after the literal prefix such as 'a%' or 'foo['.
+--- @param pattern string
+--- @return string? err
+local function checkpattern(pattern)
+    -- true if the capture is closed
+    local captures = {}
+    local i = 1
+    while i <= #pattern do
+        local c = sub(pattern, i, i)
+        if c == '(' then
+            captures[#captures + 1] = false
+            i = i + 1
+        elseif c == ')' then
+            local k = #captures
+            while k > 0 and captures[k] do
+                k = k - 1
+            end
+            if k == 0 then
+                return 'invalid pattern capture'
+            end
+            captures[k] = true
+            i = i + 1
+        elseif c == '[' then
+            i = setend(pattern, i)
+            if not i then
+                return "malformed pattern (missing ']')"
+            end
+        elseif c ~= '%' then
+            i = i + 1
+        else
+            c = sub(pattern, i + 1, i + 1)
+            if c == '' then
+                return "malformed pattern (ends with '%')"
+            elseif c == 'b' then
+                if i + 3 > #pattern then
+                    return "missing arguments to '%b'"
+                end
+                i = i + 4
+            elseif c == 'f' then
+                if sub(pattern, i + 2, i + 2) ~= '[' then
+                    return "missing '[' after '%f' in pattern"
+                end
+                i = setend(pattern, i + 2)
+                if not i then
+                    return "malformed pattern (missing ']')"
+                end
+            elseif find(c, '^%d$') and not captures[tonumber(c)] then
+                return format('invalid capture index %%%s', c)
+            else
+                i = i + 2
+            end
+        end
+    end
+
+    for _, closed in ipairs(captures) do
+        if not closed then
+            return 'unfinished capture'
+        end
+    end
+end
+
+--- setfilter sets the patterns to select the test cases by `file:testname`
+--- @param run string?
+--- @param skip string?
+--- @return string error
+local function setfilter(run, skip)
+    for i, pattern in ipairs({
+        run or false,
+        skip or false,
+    }) do
+        if pattern then
+            if type(pattern) ~= 'string' then
+                return format('invalid argument #%d (string expected, got %s)',
+                              i, type(pattern))
+            end
+            local ok, err = pcall(find, '', pattern)
+            if ok then
+                err = checkpattern(pattern)
+            end
+            if err then
+                return format('invalid argument #%d (invalid pattern %q: %s)',
+                              i, pattern, err)
+            end
+        end
+    end
+
+    FILTER = {
+        run = run,
+        skip = skip,
+    }
+end
+
+--- setexclude sets the test cases that should not be run
+--- @param ids table<string, any>? set of `file:testname`
+--- @return string error
+local function setexclude(ids)
+    if ids ~= nil and type(ids) ~= 'table' then
+        return format('invalid argument #1 (table expected, got %s)',
+                      type(ids))
+    end
+    EXCLUDE = ids
+    EXCLUDED = {}
+end
+
+--- excluded returns the test cases that are excluded by setexclude from the
+--- registered test cases that match the filter patterns. the test cases are
+--- collected by getlist, so the ones of the released test files are kept.
+--- @return table<string, boolean> ids set of `file:testname`
+local function excluded()
+    return EXCLUDED
+end
+
+--- getlist returns a list of registered test cases.
+--- the test files whose test cases are all filtered out are not included.
 --- @return table list
 --- @return number nfunc
 local function getlist()
     local slist = {}
     local ntest = 0
+    local has_filter = FILTER.run or FILTER.skip or EXCLUDE
 
     -- create sorted source list
     for src, stat in pairs(REGISTRY) do
@@ -73,19 +250,22 @@ local function getlist()
             dirname = stat.dirname,
             realpath = stat.realpath,
             tests = tests,
+            limits = stat.limits,
         }
         for name, test in pairs(stat.tests) do
             if SETUP_AND_TEARDOWN[name] then
                 -- use as a setup or teardown
                 item[name] = test.func
-            else
+            elseif not has_filter or not is_filtered(src, name) then
                 tests[#tests + 1] = test
             end
         end
-        sort(tests, cmp_lineno)
 
-        slist[#slist + 1] = item
-        ntest = ntest + #tests
+        if not has_filter or #tests > 0 then
+            sort(tests, cmp_lineno)
+            slist[#slist + 1] = item
+            ntest = ntest + #tests
+        end
     end
     sort(slist, cmp_name)
 
@@ -97,11 +277,36 @@ local function clear()
     REGISTRY = {}
 end
 
+--- getentry returns the registry entry of the source file
+--- @param source string
+--- @return table? entry
+--- @return string? error
+local function getentry(source)
+    local stat, err = fs.getstat(trim_prefix(source, '@'))
+    if not stat then
+        return nil, format('failed to get fileinfo %s', err or '')
+    end
+
+    if not REGISTRY[stat.pathname] then
+        REGISTRY[stat.pathname] = {
+            dirname = stat.dirname,
+            basename = stat.basename,
+            pathname = stat.pathname,
+            realpath = stat.realpath,
+            tests = {},
+            limits = {},
+        }
+    end
+    return REGISTRY[stat.pathname]
+end
+
 --- add function to registry
 --- @param name string
 --- @param func function
+--- @param kind string? 'async' to run as a coroutine by the scheduler of
+--- testcase.async, or 'fuzz' to run as a fuzz target by testcase.fuzz
 --- @return string error
-local function add(name, func)
+local function add(name, func, kind)
     -- verify arguments
     if type(name) ~= 'string' then
         return format('invalid argument #1 (string expected, got %s)',
@@ -109,27 +314,22 @@ local function add(name, func)
     elseif type(func) ~= 'function' then
         return format('invalid argument #2 (function expected, got %s)',
                       type(func))
+    elseif kind ~= nil and kind ~= 'async' and kind ~= 'fuzz' then
+        return format('invalid argument #3 (\'async\' or \'fuzz\' expected, ' ..
+                          'got %s)', tostring(kind))
+    elseif kind and SETUP_AND_TEARDOWN[name] then
+        return format('%s cannot be defined as %s function', name,
+                      kind == 'async' and 'an async' or 'a fuzz')
     end
 
     local info = getinfo(func, 'nS')
     local lineno = info.linedefined
-    local stat, err = fs.getstat(trim_prefix(info.source, '@'))
-
-    if not stat then
-        return format('failed to get fileinfo %s', err or '')
+    local entry, err = getentry(info.source)
+    if not entry then
+        return err
     end
 
-    if not REGISTRY[stat.pathname] then
-        REGISTRY[stat.pathname] = {
-            dirname = stat.dirname,
-            basename = stat.basename,
-            pathname = stat.pathname,
-            realpath = stat.realpath,
-            tests = {},
-        }
-    end
-
-    local tests = REGISTRY[stat.pathname].tests
+    local tests = entry.tests
     -- test case already exists
     if tests[name] then
         return format('testcase <%s:%d> already defined at lineno:%d', name,
@@ -140,11 +340,38 @@ local function add(name, func)
         name = name,
         func = func,
         lineno = lineno,
+        async = kind == 'async' or nil,
+        fuzz = kind == 'fuzz' or nil,
     }
 end
 
+--- setlimit sets the resource limits of the test case in the source file
+--- @param source string
+--- @param name string
+--- @param limit table
+--- @return string error
+local function setlimit(source, name, limit)
+    if type(name) ~= 'string' then
+        return format('invalid argument #2 (string expected, got %s)',
+                      type(name))
+    elseif type(limit) ~= 'table' then
+        return format('invalid argument #3 (table expected, got %s)',
+                      type(limit))
+    end
+
+    local entry, err = getentry(source)
+    if not entry then
+        return err
+    end
+    entry.limits[name] = limit
+end
+
 return {
     add = add,
+    setlimit = setlimit,
     clear = clear,
     getlist = getlist,
+    setfilter = setfilter,
+    setexclude = setexclude,
+    excluded = excluded,
 }
@@ -23,7 +23,18 @@
 local exit = require('testcase.exit').exit
 local collectgarbage = collectgarbage
 local ipairs = ipairs
-local traceback = debug.traceback
+local pairs = pairs
+local type = type
+local error = error
+local tostring = tostring
+local select = select
+local unpack = unpack or table.unpack
+local remove = table.remove
+local concat = table.concat
+local sort = table.sort
+local find = string.find
+local format = string.format
+local sqrt = math.sqrt
 local xpcall = require('testcase.xpcall')
 local getcwd = require('testcase.getcwd')
 local chdir = require('testcase.filesystem').chdir
@@ -34,10 +45,422 @@ local printer = require('testcase.printer')
 local print = printer.new(nil, '\n')
 local printf = printer.new()
 local printCode = printer.new('  >     ', '\n', false)
+local fmtsec = printer.fmtsec
 local iohook = require('testcase.iohook')
+-- the modules of the options are required when the options are used
+local loaded = package.loaded
 --- constants
 local PID = getpid()
 local HR = string.rep('-', 80)
+local DEFAULT_LEAKCHECK = 5
+local DEFAULT_BENCH = {
+    warmup = 3,
+    ['repeat'] = 10,
+}
+
+-- OPTIONS = {
+--     -- number of extra iterations of each test case to detect the heap
+--     -- growth. 0 disables the leak check.
+--     leakcheck = <number>,
+--     -- number of the elapsed time samples of each test case. the test case
+--     -- is run <samples> - 1 more times if it succeeds.
+--     samples = <number>,
+--     -- skip the full garbage collection before each test case.
+--     lean = <boolean>,
+--     -- resource limits of each test case.
+--     limit = {
+--         cpu = <number?>, -- CPU time in seconds
+--         memory = <number?>, -- bytes allocated by lua
+--         as = <number?>, -- address space of the process in bytes
+--         nofile = <number?>, -- number of the open files of the process
+--         nproc = <number?>, -- number of the processes of the user
+--     },
+--     -- parent directory of the scratch directory that is created for each
+--     -- test case as its working directory. false disables it.
+--     tmpdir = <string|false>,
+--     -- report the file descriptors and the child processes that are left
+--     -- open or alive by each test case. 'fail' marks the test case as
+--     -- failed, 'warn' only prints them. false disables it.
+--     fdcheck = <'warn'|'fail'|false>,
+--     -- count the VM instructions and the C function calls of each test case.
+--     icount = <boolean>,
+--     -- benchmark mode. each succeeded test case is run <warmup> times
+--     -- without measurement, and then <repeat> times with the garbage
+--     -- collector stopped. the process is pinned to the <cpu> while running.
+--     bench = {
+--         warmup = <integer>,
+--         repeat = <integer>,
+--         cpu = <integer?>,
+--     } | false,
+-- }
+local OPTIONS = {
+    leakcheck = 0,
+    samples = 1,
+    lean = false,
+    tmpdir = false,
+    fdcheck = false,
+    icount = false,
+    bench = false,
+}
+-- working directory of the running test file
+local CWD
+-- functions that receive the events of the runner
+local LISTENERS = {}
+-- resources that are limited by setrlimit
+local RLIMIT_RESOURCES = {
+    'as',
+    'nofile',
+    'nproc',
+}
+
+--- check_limit returns v if v is a valid resource limits table
+--- @param v any
+--- @return table? v
+--- @return string? err
+local function check_limit(v)
+    if v == nil then
+        return nil
+    elseif type(v) ~= 'table' then
+        return nil, format('table expected, got %s', type(v))
+    end
+    for k, n in pairs(v) do
+        if k ~= 'cpu' and k ~= 'memory' and k ~= 'as' and k ~= 'nofile' and
+            k ~= 'nproc' then
+            return nil, format('unknown resource %q', tostring(k))
+        elseif type(n) ~= 'number' or n ~= n or n <= 0 then
+            return nil, format('%s must be a positive number, got %s', k,
+                               tostring(n))
+        end
+    end
+    return v
+end
+
+--- trace_begin begins the span if the trace module is loaded. the module is
+--- loaded by the command of the --trace option, and no span is written
+--- otherwise.
+--- @param name string
+--- @param cat string
+--- @param tid integer?
+--- @return table? span
+local function trace_begin(name, cat, tid)
+    local trace = loaded['testcase.trace']
+    return trace and trace.begin(name, cat, tid)
+end
+
+--- trace_finish finishes the span returned by trace_begin
+--- @param span table?
+--- @param args table?
+local function trace_finish(span, args)
+    if span then
+        loaded['testcase.trace'].finish(span, args)
+    end
+end
+
+--- is_dir returns true if the pathname is a directory
+--- @param pathname string
+--- @return boolean
+local function is_dir(pathname)
+    local info = require('testcase.fstat')(pathname)
+    return info ~= nil and info.type == 'directory'
+end
+
+--- default_tmpdir returns the parent directory of the scratch directories.
+--- the tmpfs mounted on /dev/shm is preferred to create and remove the
+--- files fast.
+--- @return string
+local function default_tmpdir()
+    if is_dir('/dev/shm') then
+        return '/dev/shm'
+    end
+    local dir = os.getenv('TMPDIR')
+    if dir and dir ~= '' and is_dir(dir) then
+        return dir
+    end
+    return '/tmp'
+end
+
+--- check_bench returns the benchmark options that merges v into the default
+--- options
+--- @param v any
+--- @return table|false? v
+--- @return string? err
+local function check_bench(v)
+    if v == nil or v == false then
+        return false
+    elseif v == true then
+        v = {}
+    elseif type(v) ~= 'table' then
+        return nil, format('table or boolean expected, got %s', type(v))
+    end
+
+    local opts = {
+        cpu = v.cpu,
+    }
+    for k, n in pairs(v) do
+        if DEFAULT_BENCH[k] == nil and k ~= 'cpu' then
+            return nil, format('unknown option %q', tostring(k))
+        elseif type(n) ~= 'number' or n ~= n or n % 1 ~= 0 or n < 0 then
+            return nil, format('%s must be an unsigned integer, got %s', k,
+                               tostring(n))
+        elseif k == 'repeat' and n < 2 then
+            return nil, format('repeat must be greater than 1, got %d', n)
+        end
+    end
+    for k, n in pairs(DEFAULT_BENCH) do
+        opts[k] = v[k] or n
+    end
+    return opts
+end
+
+local VALIDATE_OPTION = {
+    bench = check_bench,
+    leakcheck = function(v)
+        if v == true then
+            return DEFAULT_LEAKCHECK
+        elseif v == false or v == nil then
+            return 0
+        elseif type(v) ~= 'number' or v ~= v or v % 1 ~= 0 or v < 2 then
+            return nil, format('integer greater than 1 expected, got %s',
+                               tostring(v))
+        end
+        return v
+    end,
+    limit = check_limit,
+    lean = function(v)
+        if v == nil then
+            return false
+        elseif type(v) ~= 'boolean' then
+            return nil, format('boolean expected, got %s', type(v))
+        end
+        return v
+    end,
+    icount = function(v)
+        if v == nil then
+            return false
+        elseif type(v) ~= 'boolean' then
+            return nil, format('boolean expected, got %s', type(v))
+        end
+        return v
+    end,
+    tmpdir = function(v)
+        if v == true then
+            return default_tmpdir()
+        elseif v == false or v == nil then
+            return false
+        elseif type(v) ~= 'string' then
+            return nil, format('string or boolean expected, got %s', type(v))
+        elseif not is_dir(v) then
+            return nil, format('%q is not a directory', v)
+        end
+        return v
+    end,
+    fdcheck = function(v)
+        if v == true then
+            return 'fail'
+        elseif v == false or v == nil then
+            return false
+        elseif v ~= 'warn' and v ~= 'fail' then
+            return nil, format('"warn" or "fail" expected, got %s',
+                               tostring(v))
+        end
+        return v
+    end,
+    samples = function(v)
+        if v == nil then
+            return 1
+        elseif type(v) ~= 'number' or v ~= v or v % 1 ~= 0 or v < 1 then
+            return nil, format('integer greater than 0 expected, got %s',
+                               tostring(v))
+        end
+        return v
+    end,
+}
+
+--- setopt sets the value of runner option
+--- @param name string
+--- @param val any
+local function setopt(name, val)
+    local validate = VALIDATE_OPTION[name]
+    if not validate then
+        error(format('unknown option %q', tostring(name)), 2)
+    end
+
+    local v, err = validate(val)
+    if err then
+        error(format('invalid %s option: %s', name, err), 2)
+    end
+    OPTIONS[name] = v
+end
+
+--- setlimit sets the resource limits and returns the function to restore them
+--- @param limit table
+--- @return function? restore
+--- @return string? err
+local function setlimit(limit)
+    local rlimit = require('testcase.rlimit')
+    local saved = {}
+    local restored = false
+    local function restore()
+        if restored then
+            return
+        end
+        if limit.cpu then
+            rlimit.cpu()
+        end
+        -- the CPU timer can raise an error until it is disarmed. restore is
+        -- called again in that case.
+        restored = true
+        if limit.memory then
+            rlimit.memory()
+        end
+        for k, v in pairs(saved) do
+            rlimit.set(k, v)
+        end
+    end
+
+    for _, k in ipairs(RLIMIT_RESOURCES) do
+        if limit[k] then
+            local cur, err = rlimit.get(k)
+            if not cur then
+                restore()
+                return nil, format('failed to get %s limit: %s', k, err)
+            end
+            saved[k] = cur
+
+            local ok
+            ok, err = rlimit.set(k, limit[k])
+            if not ok then
+                restore()
+                return nil, format('failed to set %s limit: %s', k, err)
+            end
+        end
+    end
+
+    for _, k in ipairs({
+        'cpu',
+        'memory',
+    }) do
+        if limit[k] then
+            local ok, err = rlimit[k](limit[k])
+            if not ok then
+                restore()
+                return nil, format('failed to set %s limit: %s', k, err)
+            end
+        end
+    end
+
+    return restore
+end
+
+--- rlimit_breached returns the name of the setrlimit limit that caused the
+--- error. the system calls fail with EMFILE, EAGAIN or ENOMEM when the
+--- process reaches the limit, and lua fails with the memory error.
+--- @param limit table
+--- @param err any
+--- @return string? kind
+local function rlimit_breached(limit, err)
+    local rlimit = require('testcase.rlimit')
+    local msg = tostring(err)
+    for _, k in ipairs(RLIMIT_RESOURCES) do
+        if limit[k] and (find(msg, rlimit.errmsg(k), 1, true) or
+            (k == 'as' and find(msg, 'not enough memory', 1, true))) then
+            return k
+        end
+    end
+end
+
+--- limited calls testfn with the resource limits
+--- @param limit table
+--- @param testfn function
+--- @return boolean ok
+--- @return any err
+local function limited(limit, testfn)
+    local restore
+    -- the limits are set and released in the protected call so that the
+    -- error raised by the limits is not thrown outside of it
+    local ok, err = xpcall(function()
+        local lerr
+        restore, lerr = setlimit(limit)
+        if not restore then
+            error(lerr, 0)
+        end
+        local fok, ferr = xpcall(testfn)
+        restore()
+        if not fok then
+            -- rethrow the captured error object as it is
+            error(ferr, 0)
+        end
+    end)
+    if restore then
+        -- release the limits if restore was interrupted by the error
+        restore()
+    end
+
+    -- report the breached limit as a failure even if the error is caught in
+    -- the test case
+    local kind = require('testcase.rlimit').exceeded() or
+                     (not ok and rlimit_breached(limit, err))
+    if kind then
+        ok = false
+        err = format('%s limit exceeded', kind) ..
+                  (err and '\n' .. tostring(err) or '')
+    end
+    return ok, err
+end
+
+--- forked calls testfn with the resource limits in a child process, so that
+--- the setrlimit limits and the side effects of the test case do not affect
+--- the runner process. the result is passed through a temporary file that
+--- starts with '+' on success or '-' followed by the error message on
+--- failure.
+--- @param limit table
+--- @param testfn function
+--- @return boolean ok
+--- @return any err
+local function forked(limit, testfn)
+    local f, err = io.tmpfile()
+    if not f then
+        return false, format('failed to create the result file: %s', err)
+    end
+
+    -- the buffered output must not be written twice by the child process
+    io.stdout:flush()
+    io.stderr:flush()
+    local p
+    p, err = require('testcase.fork')()
+    if not p then
+        f:close()
+        return false, format('failed to fork the test process: %s', err)
+    elseif p:is_child() then
+        local pid = getpid()
+        local ok, cerr = limited(limit, testfn)
+        if getpid() ~= pid then
+            -- exit if process is forked in testfn
+            exit()
+        end
+        f:write(ok and '+' or '-' .. tostring(cerr))
+        f:flush()
+        exit(ok and 0 or 1)
+    end
+
+    local res, werr = p:wait()
+    f:seek('set')
+    local msg = f:read('*a') or ''
+    f:close()
+    if not res then
+        return false, format('failed to wait for the test process: %s',
+                             tostring(werr))
+    elseif find(msg, '^%+') then
+        return true
+    elseif find(msg, '^%-') then
+        return false, msg:sub(2)
+    elseif res.sigterm then
+        return false, format('test process terminated by signal %d',
+                             res.sigterm)
+    end
+    return false, format('test process exited with status %s',
+                         tostring(res.exit))
+end
 
 --- call a function by xpcall
 --- @param t userdata
@@ -45,18 +468,35 @@ local HR = string.rep('-', 80)
 --- @param hookfn function
 --- @param hook_startfn function
 --- @param hook_endfn function
+--- @param limit table? resource limits. the test case is run in a child
+--- process if the setrlimit limits are specified.
 --- @return boolean ok
---- @return string err
---- @return number elapsed
---- @return string elapsed_format
-local function call(t, func, hookfn, hook_startfn, hook_endfn)
-    local cwd = assert(getcwd())
+--- @return any err error object captured by testcase.xpcall. it is rendered
+--- with the stack traceback by tostring.
+--- @return integer elapsed elapsed time in nanoseconds
+local function call(t, func, hookfn, hook_startfn, hook_endfn, limit)
+    local run = xpcall
+    if limit then
+        run = limited
+        for _, k in ipairs(RLIMIT_RESOURCES) do
+            if limit[k] then
+                run = forked
+                break
+            end
+        end
+        local runfn = run
+        run = function(testfn)
+            return runfn(limit, testfn)
+        end
+    end
 
-    collectgarbage('collect')
+    if not OPTIONS.lean then
+        collectgarbage('collect')
+    end
     iohook.hook(hookfn, hook_startfn, hook_endfn)
     t:start()
-    local ok, err = xpcall(func, traceback)
-    local elapsed, fmt = t:stop()
+    local ok, err = run(func)
+    local elapsed = t:lap()
     iohook.unhook()
 
     -- exit if process is forked in func
@@ -65,10 +505,254 @@ local function call(t, func, hookfn, hook_startfn, hook_endfn)
     end
 
     -- move to test working directory
-    local cerr = chdir(cwd)
+    local cerr = chdir(CWD)
     assert(not cerr, cerr)
 
-    return ok, err, elapsed, fmt
+    return ok, err, elapsed
+end
+
+--- in_tmpdir returns the function that calls func in a new scratch directory
+--- and removes the directory after the call
+--- @param func function
+--- @return function
+local function in_tmpdir(func)
+    local tmpdir = require('testcase.tmpdir')
+    return function()
+        local dir, err = tmpdir.new(OPTIONS.tmpdir)
+        if not dir then
+            error(format('failed to create the scratch directory: %s',
+                         tostring(err)), 0)
+        end
+        local cerr = chdir(dir)
+        if cerr then
+            tmpdir.remove(dir)
+            error(format('failed to change to the scratch directory: %s',
+                         tostring(cerr)), 0)
+        end
+
+        local ok, ferr = xpcall(func)
+        -- the child process forked in func must not remove the directory
+        if getpid() == PID then
+            chdir(CWD)
+            local rok, rerr = tmpdir.remove(dir)
+            if ok and not rok then
+                error(format('failed to remove the scratch directory: %s',
+                             tostring(rerr)), 0)
+            end
+        end
+        if not ok then
+            -- rethrow the captured error object as it is
+            error(ferr, 0)
+        end
+    end
+end
+
+--- sample runs a function repeatedly and collects the elapsed time of each
+--- run in seconds.
+--- @param func function
+--- @param nsample number
+--- @param elapsed integer elapsed time of the first run in nanoseconds
+--- @return number[]? samples nil if the function fails in the repeated runs
+local function sample(func, nsample, elapsed)
+    local t = timer.new()
+    local samples = {
+        elapsed / 1e9,
+    }
+
+    for i = 2, nsample do
+        -- discard the outputs
+        collectgarbage('collect')
+        iohook.hook()
+        t:start()
+        local ok = xpcall(func)
+        elapsed = t:lap()
+        iohook.unhook()
+
+        -- exit if process is forked in func
+        if getpid() ~= PID then
+            exit()
+        end
+
+        local cerr = chdir(CWD)
+        assert(not cerr, cerr)
+        if not ok then
+            return
+        end
+        samples[i] = elapsed / 1e9
+    end
+
+    return samples
+end
+
+--- bench runs a function <warmup> times to warm up the caches, and then
+--- runs it <repeat> times with the garbage collector stopped to collect the
+--- elapsed time of each run in seconds.
+--- @param func function
+--- @param opts table
+--- @return number[]? samples nil if the function fails in the repeated runs
+local function bench(func, opts)
+    local t = timer.new()
+    local samples = {}
+
+    for i = 1, opts.warmup + opts['repeat'] do
+        local measured = i > opts.warmup
+        -- discard the outputs
+        collectgarbage('collect')
+        if measured then
+            collectgarbage('stop')
+        end
+        iohook.hook()
+        t:start()
+        local ok = xpcall(func)
+        local elapsed = t:lap()
+        iohook.unhook()
+        collectgarbage('restart')
+
+        -- exit if process is forked in func
+        if getpid() ~= PID then
+            exit()
+        end
+
+        local cerr = chdir(CWD)
+        assert(not cerr, cerr)
+        if not ok then
+            return
+        elseif measured then
+            samples[#samples + 1] = elapsed / 1e9
+        end
+    end
+
+    return samples
+end
+
+--- stats returns the mean, the sample standard deviation and the minimum of
+--- the samples
+--- @param samples number[]
+--- @return number mean
+--- @return number stddev
+--- @return number min
+local function stats(samples)
+    local n = #samples
+    local sum = 0
+    local min = samples[1]
+    for _, v in ipairs(samples) do
+        sum = sum + v
+        if v < min then
+            min = v
+        end
+    end
+    local mean = sum / n
+    local sqsum = 0
+    for _, v in ipairs(samples) do
+        sqsum = sqsum + (v - mean) ^ 2
+    end
+    return mean, sqrt(sqsum / (n - 1)), min
+end
+
+--- leakcheck runs a function repeatedly and measures the retained heap size
+--- after a full garbage collection between the runs.
+--- @param func function
+--- @param niter number
+--- @return number? growth average growth of the heap in kilobytes per
+--- iteration if the heap keeps growing in all iterations.
+local function leakcheck(func, niter)
+    collectgarbage('collect')
+    collectgarbage('collect')
+    local prev = collectgarbage('count')
+    local growth = 0
+    for _ = 1, niter do
+        -- discard the outputs
+        iohook.hook()
+        local ok = xpcall(func)
+        iohook.unhook()
+
+        -- exit if process is forked in func
+        if getpid() ~= PID then
+            exit()
+        end
+
+        local cerr = chdir(CWD)
+        assert(not cerr, cerr)
+        if not ok then
+            return
+        end
+
+        -- twice to release the objects resurrected by the finalizers
+        collectgarbage('collect')
+        collectgarbage('collect')
+        local cur = collectgarbage('count')
+        if cur <= prev then
+            -- the heap did not grow in this iteration
+            return
+        end
+        growth = growth + cur - prev
+        prev = cur
+    end
+
+    return growth / niter
+end
+
+--- snapshot returns the open file descriptors and the child processes
+--- @return table<integer, table> fds
+--- @return table<integer, table>? children nil if not supported
+local function snapshot()
+    local procinfo = require('testcase.procinfo')
+    local fds = assert(procinfo.fds())
+    local children = {}
+    local list = procinfo.children()
+    if not list then
+        return fds
+    end
+    for _, v in ipairs(list) do
+        children[v.pid] = v
+    end
+    return fds, children
+end
+
+--- check_leaks returns the message of the file descriptors and the child
+--- processes that are not in the snapshot taken before the test case
+--- @param fds table<integer, table>
+--- @param children table<integer, table>?
+--- @return string? msg
+local function check_leaks(fds, children)
+    -- take the snapshot before the garbage collection so that the
+    -- descriptors left to the finalizers are also reported
+    local curfds, curchildren = snapshot()
+    collectgarbage('collect')
+    collectgarbage('collect')
+    local gcfds = snapshot()
+
+    local leaks = {}
+    local list = {}
+    for fd in pairs(curfds) do
+        if not fds[fd] then
+            list[#list + 1] = fd
+        end
+    end
+    sort(list)
+    for _, fd in ipairs(list) do
+        local v = curfds[fd]
+        leaks[#leaks + 1] = format('fd %d (%s%s%s)', fd, v.type,
+                                   v.path and ': ' .. v.path or '',
+                                   gcfds[fd] and '' or ', closed by gc')
+    end
+
+    list = {}
+    if children and curchildren then
+        for pid in pairs(curchildren) do
+            if not children[pid] then
+                list[#list + 1] = pid
+            end
+        end
+        sort(list)
+    end
+    for _, pid in ipairs(list) do
+        leaks[#leaks + 1] = format('pid %d (%s)', pid, curchildren[pid].state)
+    end
+
+    if #leaks > 0 then
+        return 'leaked resources: ' .. concat(leaks, ', ')
+    end
 end
 
 local function test_hook(...)
@@ -87,20 +771,215 @@ end
 ---@param t userdata
 ---@param name string
 ---@param func function
+---@param limit table? resource limits
 ---@return boolean ok
 ---@return any err
-local function run_test(t, name, func)
+---@return number[]? samples
+---@return integer elapsed elapsed time in nanoseconds
+---@return table? counts the numbers of the VM instructions and the C function
+--- calls if the icount option is enabled
+---@return number? growth growth of the heap in kilobytes per iteration if
+--- the leakcheck option detects the leak
+local function run_test(t, name, func, limit)
+    local span = trace_begin(name, 'test')
     printf('- %s ... ', name)
-    local ok, err, elapsed, fmt = call(t, func, test_hook, test_hook_start,
-                                       test_hook_end)
-    printf('%s (' .. fmt .. ')', ok and 'ok' or 'fail', elapsed)
+    local fds, children
+    if OPTIONS.fdcheck then
+        fds, children = snapshot()
+    end
+    -- the repeated runs do not measure the instructions
+    local repeatfn = func
+    local counts
+    if OPTIONS.icount then
+        local testfn = func
+        func = function()
+            counts = require('testcase.icount').measure(testfn)
+        end
+    end
+    if OPTIONS.tmpdir then
+        func = in_tmpdir(func)
+        repeatfn = in_tmpdir(repeatfn)
+    end
+    local ok, err, elapsed = call(t, func, test_hook, test_hook_start,
+                                  test_hook_end, limit)
+    local leaks = fds and check_leaks(fds, children)
+    if leaks and OPTIONS.fdcheck == 'fail' then
+        ok = false
+        err = err and tostring(err) .. '\n' .. leaks or leaks
+        leaks = nil
+    end
+    local v, fmt = timer.format(elapsed)
+    printf('%s (' .. fmt .. ')', ok and 'ok' or 'fail', v)
+    if ok and counts then
+        printf(' [%d instructions, %d C calls]', counts.instructions,
+               counts.ccalls)
+    end
+    trace_finish(span, {
+        ok = ok,
+    })
     if ok then
+        local samples
+        if OPTIONS.bench then
+            samples = bench(repeatfn, OPTIONS.bench)
+            if not samples then
+                printf(' (unstable: failed in the repeated runs)')
+            else
+                local mean, stddev, min = stats(samples)
+                printf(' [mean %s ± %s, min %s, n=%d]', fmtsec(mean),
+                       fmtsec(stddev), fmtsec(min), #samples)
+            end
+        elseif OPTIONS.samples > 1 then
+            samples = sample(repeatfn, OPTIONS.samples, elapsed)
+            if not samples then
+                printf(' (unstable: failed in the repeated runs)')
+            end
+        end
+        local growth
+        if OPTIONS.leakcheck > 0 then
+            growth = leakcheck(repeatfn, OPTIONS.leakcheck)
+            if growth then
+                printf(' leak: +%.3f KB/iter', growth)
+            end
+        end
         printf('\n')
-        return true
+        if leaks then
+            printCode('warning: ' .. leaks)
+        end
+        return true, nil, samples, elapsed, counts, growth
     end
     printf('  \n')
     printCode(err)
-    return false, err
+    if leaks then
+        printCode('warning: ' .. leaks)
+    end
+    return false, err, nil, elapsed
+end
+
+--- run async test functions concurrently by the scheduler of testcase.async
+---@param t userdata
+---@param tests table[]
+---@return table[] results
+local function run_async_tests(t, tests)
+    local async = require('testcase.async')
+    local tmpdir = require('testcase.tmpdir')
+    local funcs = {}
+    -- scratch directories of the tasks
+    local dirs = {}
+    for i, test in ipairs(tests) do
+        local func = test.func
+        if OPTIONS.tmpdir then
+            local dir, err = tmpdir.new(OPTIONS.tmpdir)
+            if not dir then
+                func = function()
+                    error(format('failed to create the scratch directory: %s',
+                                 tostring(err)), 0)
+                end
+            end
+            dirs[i] = dir
+        end
+        funcs[i] = func
+    end
+
+    local results = {}
+    local timers = {}
+    local spans = {}
+    local outputs = {}
+    -- the elapsed time of each task is the wall time from its start to its
+    -- finish minus the time spent running the other tasks in the meantime.
+    -- nsrun is the total time spent running the tasks, and runs[id] holds
+    -- nsrun at the start of the task and the time spent running the task.
+    local runtimer = timer.new()
+    local nsrun = 0
+    local runs = {}
+    if not OPTIONS.lean then
+        collectgarbage('collect')
+    end
+    t:start()
+    async.run(funcs, {
+        start = function(task)
+            outputs[task.id] = {}
+            -- each task is traced in its own track
+            spans[task.id] = trace_begin(tests[task.id].name, 'test', task.id)
+            timers[task.id] = timer.new()
+            timers[task.id]:start()
+            runs[task.id] = {
+                base = nsrun,
+                ns = 0,
+            }
+        end,
+        resume = function(task)
+            -- each task has its own working directory
+            if dirs[task.id] then
+                local cerr = chdir(dirs[task.id])
+                assert(not cerr, cerr)
+            end
+            -- buffer the outputs until the test finishes
+            local outs = outputs[task.id]
+            iohook.hook(function(...)
+                outs[#outs + 1] = {
+                    n = select('#', ...),
+                    ...,
+                }
+            end)
+            runtimer:start()
+        end,
+        suspend = function(task)
+            local ns = runtimer:lap()
+            nsrun = nsrun + ns
+            runs[task.id].ns = runs[task.id].ns + ns
+            iohook.unhook()
+            -- exit if process is forked in func
+            if getpid() ~= PID then
+                exit()
+            end
+            -- move to test working directory
+            local cerr = chdir(CWD)
+            assert(not cerr, cerr)
+        end,
+        finish = function(task)
+            local run = runs[task.id]
+            local ns = timers[task.id]:lap() - (nsrun - run.base - run.ns)
+            if ns < 0 then
+                ns = 0
+            end
+            if dirs[task.id] then
+                local ok, err = tmpdir.remove(dirs[task.id])
+                if task.ok and not ok then
+                    task.ok = false
+                    task.err = format('failed to remove the scratch ' ..
+                                          'directory: %s', tostring(err))
+                end
+            end
+            local elapsed, fmt = timer.format(ns)
+            trace_finish(spans[task.id], {
+                ok = task.ok,
+            })
+            local outs = outputs[task.id]
+            printf('- %s ... ', tests[task.id].name)
+            if #outs > 0 then
+                test_hook_start()
+                for _, args in ipairs(outs) do
+                    test_hook(unpack(args, 1, args.n))
+                end
+                test_hook_end()
+            end
+            printf('%s (' .. fmt .. ')', task.ok and 'ok' or 'fail', elapsed)
+            if task.ok then
+                printf('\n')
+            else
+                printf('  \n')
+                printCode(task.err)
+            end
+            results[task.id] = {
+                ok = task.ok,
+                err = task.err,
+                elapsed = ns,
+            }
+        end,
+    })
+    t:stop()
+
+    return results
 end
 
 local function setup_teardown_hook(...)
@@ -118,9 +997,13 @@ end
 ---@return boolean
 ---@return any err
 local function run_setup_teadown(t, name, func)
+    local span = trace_begin(name, 'setup')
     local ok, err = call(t, func, setup_teardown_hook, function()
         print('- ', name)
     end, setup_teardown_end)
+    trace_finish(span, {
+        ok = ok,
+    })
 
     if not ok and err then
         print('  failed to call ', name)
@@ -131,33 +1014,119 @@ local function run_setup_teadown(t, name, func)
     return ok
 end
 
+--- getlimit returns the resource limits of the test case that merges the
+--- limits of the test case into the limit option
+--- @param src table
+--- @param name string
+--- @return table? limit
+--- @return string? err
+local function getlimit(src, name)
+    local limit, err = check_limit(src.limits and src.limits[name])
+    if err then
+        return nil, format('invalid limit of %s: %s', name, err)
+    elseif not limit then
+        return OPTIONS.limit
+    elseif not OPTIONS.limit then
+        return limit
+    end
+
+    local merged = {}
+    for k, v in pairs(OPTIONS.limit) do
+        merged[k] = v
+    end
+    for k, v in pairs(limit) do
+        merged[k] = v
+    end
+    return merged
+end
+
+--- emit passes the event to the listener
+--- @param event table
+local function emit(event)
+    for _, fn in ipairs(LISTENERS) do
+        fn(event)
+    end
+end
+
+--- emit_done passes the done event of the test file to the listener
+--- @param src table
+--- @param nsuccess integer
+--- @param errs table[]
+local function emit_done(src, nsuccess, errs)
+    if #LISTENERS == 0 then
+        return
+    end
+
+    -- the error objects are converted to strings to be serializable
+    local errors = {}
+    for i, v in ipairs(errs) do
+        errors[i] = {
+            name = v.name,
+            error = tostring(v.error),
+        }
+    end
+    emit({
+        event = 'done',
+        file = src.name,
+        nsuccess = nsuccess,
+        nfailure = #src.tests - nsuccess,
+        errors = errors,
+    })
+end
+
 --- run test file
 --- @param t userdata timer
 --- @param src table
+--- @param samples table<string, number[]> elapsed time samples of the test
+--- cases are stored by the `file:testname` key
 --- @return number nsuccess
 --- @return table[] errors
-local function run_file(t, src)
+local function run_file(t, src, samples)
     local ntest = #src.tests
+    -- test cases are run in the directory of the test file
+    CWD = assert(getcwd())
 
     print('')
     print(HR)
     print('%s: %d test cases', src.name, ntest)
     print(HR)
+    emit({
+        event = 'file',
+        file = src.name,
+        ntest = ntest,
+    })
 
     local errs = {}
     --- call before_all
     if src.before_all then
         local ok, err = run_setup_teadown(t, 'before_all', src.before_all)
         if not ok then
-            return 0, {
+            errs[1] = {
                 name = 'before_all',
                 error = err,
             }
+            emit_done(src, 0, errs)
+            return 0, errs
         end
     end
 
     local nsuccess = 0
-    for _, test in ipairs(src.tests) do
+    local tests = src.tests
+    local serial = src.before_each or src.after_each
+    local i = 1
+    while i <= ntest do
+        -- consecutive async test cases run concurrently if before_each and
+        -- after_each are not defined
+        local group = {
+            tests[i],
+        }
+        if tests[i].async and not serial then
+            while tests[i + #group] and tests[i + #group].async do
+                group[#group + 1] = tests[i + #group]
+            end
+        end
+        i = i + #group
+
         -- call before_each
         if src.before_each then
             local ok, err = run_setup_teadown(t, 'before_each', src.before_each)
@@ -171,19 +1140,66 @@ local function run_file(t, src)
         end
 
         -- call test
-        local ok, err = run_test(t, test.name, test.func)
-        if ok then
-            nsuccess = nsuccess + 1
+        local results
+        if group[1].async then
+            results = run_async_tests(t, group)
         else
-            errs[#errs + 1] = {
-                name = test.name,
-                error = err,
+            local test = group[1]
+            local func = test.func
+            if test.fuzz then
+                func = function()
+                    require('testcase.fuzz').run(test.name, test.func)
+                end
+            end
+            local limit, err = getlimit(src, test.name)
+            local ok, list, elapsed, counts, growth
+            if err then
+                printf('- %s ... fail  \n', test.name)
+                printCode(err)
+            else
+                ok, err, list, elapsed, counts, growth = run_test(t, test.name,
+                                                                  func, limit)
+            end
+            results = {
+                {
+                    ok = ok,
+                    err = err,
+                    samples = list,
+                    elapsed = elapsed,
+                    counts = counts,
+                    leak = growth,
+                },
             }
         end
+        for j, res in ipairs(results) do
+            emit({
+                event = 'test',
+                file = src.name,
+                name = group[j].name,
+                ok = res.ok == true,
+                elapsed = res.elapsed or 0,
+                samples = res.samples,
+                instructions = res.counts and res.counts.instructions,
+                ccalls = res.counts and res.counts.ccalls,
+                leak = res.leak,
+                error = res.err ~= nil and tostring(res.err) or nil,
+            })
+            if res.ok then
+                nsuccess = nsuccess + 1
+                if res.samples then
+                    samples[src.name .. ':' .. group[j].name] = res.samples
+                end
+            else
+                errs[#errs + 1] = {
+                    name = group[j].name,
+                    error = res.err,
+                }
+            end
+        end
 
         -- call after_each
         if src.after_each then
-            ok, err = run_setup_teadown(t, 'after_each', src.after_each)
+            local ok, err = run_setup_teadown(t, 'after_each', src.after_each)
             if not ok then
                 errs[#errs + 1] = {
                     name = 'after_each',
@@ -205,7 +1221,11 @@ local function run_file(t, src)
         end
     end
 
+    -- the virtual clock enabled by the test file must not affect other files
+    timer.virtual(false)
+
     print('\n%d successes, %d failures', nsuccess, ntest - nsuccess)
+    emit_done(src, nsuccess, errs)
 
     return nsuccess, errs
 end
@@ -220,23 +1240,76 @@ local function unblock()
     DO_NOT_RUN = false
 end
 
+--- listen adds the function that receives the events of the runner.
+--- the events are passed as the following tables;
+---  { event = 'file', file = <string>, ntest = <integer> }
+---  { event = 'test', file = <string>, name = <string>, ok = <boolean>,
+---    elapsed = <integer>, samples = <number[]?>, instructions = <number?>,
+---    ccalls = <number?>, leak = <number?>, error = <string?> }
+---  { event = 'done', file = <string>, nsuccess = <integer>,
+---    nfailure = <integer>, errors = { { name = <string>,
+---    error = <string> }, ... } }
+--- the elapsed time is in nanoseconds, the samples are in seconds as
+--- returned by run, and the leak is the heap growth in kilobytes per
+--- iteration detected by the leakcheck option.
+--- @param fn function
+local function listen(fn)
+    if type(fn) ~= 'function' then
+        error(format('invalid argument #1 (function expected, got %s)',
+                     type(fn)), 2)
+    end
+    LISTENERS[#LISTENERS + 1] = fn
+end
+
+--- unlisten removes the function added by listen
+--- @param fn function
+local function unlisten(fn)
+    for i, v in ipairs(LISTENERS) do
+        if v == fn then
+            remove(LISTENERS, i)
+            return
+        end
+    end
+end
+
 --- run registered test funcs
+---@param t userdata? timer to accumulate the elapsed time
 ---@return boolean ok
 ---@return string? err
 ---@return number? nsuccess
 ---@return number? nfailures
 ---@return userdata? timer
 ---@return table[]? errors
-local function run()
+---@return table<string, number[]>? samples elapsed time samples in seconds
+--- by the `file:testname` key if the samples option is greater than 1
+local function run(t)
     if DO_NOT_RUN then
         return false, 'cannot run test cases while blocking'
     end
 
+    -- pin the process to the CPU to avoid the migration between the cores
+    local cpus
+    if OPTIONS.bench and OPTIONS.bench.cpu then
+        local err
+        cpus, err = require('testcase.affinity').get()
+        if not cpus then
+            return false, format('failed to get the CPU affinity: %s',
+                                 tostring(err))
+        end
+        local ok
+        ok, err = require('testcase.affinity').set(OPTIONS.bench.cpu)
+        if not ok then
+            return false, format('failed to pin to CPU %d: %s',
+                                 OPTIONS.bench.cpu, tostring(err))
+        end
+    end
+
     local list, ntest = registry.getlist()
-    local t = timer.new()
+    t = t or timer.new()
     local nsuccess = 0
     local errors = {}
     local nerrors = 0
+    local samples = {}
     for _, src in ipairs(list) do
         -- move to test file directory
         local err = chdir()
@@ -244,7 +1317,12 @@ local function run()
         err = chdir(src.dirname)
         assert(not err, err)
 
-        local n, errs = run_file(t, src)
+        local span = trace_begin(src.name, 'file')
+        local n, errs = run_file(t, src, samples)
+        trace_finish(span, {
+            nsuccess = n,
+            nfailure = #src.tests - n,
+        })
         nsuccess = nsuccess + n
         if #errs > 0 then
             errors[#errors + 1] = {
@@ -259,15 +1337,21 @@ local function run()
 
     -- move to the initial working directory
     chdir()
+    if cpus then
+        require('testcase.affinity').set(cpus)
+    end
     print('')
     print(HR)
     print('')
 
-    return true, nil, nsuccess, ntest - nsuccess, t, errors
+    return true, nil, nsuccess, ntest - nsuccess, t, errors, samples
 end
 
 return {
     block = block,
     unblock = unblock,
     run = run,
+    setopt = setopt,
+    listen = listen,
+    unlisten = unlisten,
 }
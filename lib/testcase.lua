@@ -21,6 +21,7 @@
 --
 local error = error
 local setmetatable = setmetatable
+local getinfo = debug.getinfo
 local registry = require('testcase.registry')
 
 --- create constructor of new metamodule
@@ -33,6 +34,60 @@ local function register(_, name, func)
     end
 end
 
+--- register the function as an async test case
+---@param name string
+---@param func function
+local function register_async(_, name, func)
+    local err = registry.add(name, func, 'async')
+    if err then
+        error(err, 2)
+    end
+end
+
+-- testcase.async.<name> = <function> registers an async test case that runs
+-- as a coroutine, and can suspend itself by the functions of testcase.async
+-- module.
+local ASYNC = setmetatable({}, {
+    __newindex = register_async,
+})
+
+--- register the function as a fuzz target
+---@param name string
+---@param func function
+local function register_fuzz(_, name, func)
+    local err = registry.add(name, func, 'fuzz')
+    if err then
+        error(err, 2)
+    end
+end
+
+-- testcase.fuzz.<name> = <function> registers a fuzz target that is called
+-- with the generated inputs by testcase.fuzz module.
+local FUZZ = setmetatable({}, {
+    __newindex = register_fuzz,
+})
+
+--- set the resource limits of the test case
+---@param name string
+---@param limit table
+local function register_limit(_, name, limit)
+    local err = registry.setlimit(getinfo(2, 'S').source, name, limit)
+    if err then
+        error(err, 2)
+    end
+end
+
+-- testcase.limit.<name> = <table> sets the resource limits of the test case
+-- defined in the same file.
+local LIMIT = setmetatable({}, {
+    __newindex = register_limit,
+})
+
 return setmetatable({}, {
     __newindex = register,
+    __index = {
+        async = ASYNC,
+        fuzz = FUZZ,
+        limit = LIMIT,
+    },
 })
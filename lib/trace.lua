@@ -0,0 +1,180 @@
+--
+-- Copyright (C) 2023 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to deal
+-- in the Software without restriction, including without limitation the rights
+-- to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+-- copies of the Software, and to permit persons to whom the Software is
+-- furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+-- OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+-- THE SOFTWARE.
+--
+--- file scope variables
+local pairs = pairs
+local tostring = tostring
+local type = type
+local concat = table.concat
+local format = string.format
+local gsub = string.gsub
+local open = io.open
+local getpid = require('testcase.getpid')
+local clock = require('testcase.timer').clock
+--- constants
+local ESCAPES = {
+    ['"'] = '\\"',
+    ['\\'] = '\\\\',
+    ['\b'] = '\\b',
+    ['\f'] = '\\f',
+    ['\n'] = '\\n',
+    ['\r'] = '\\r',
+    ['\t'] = '\\t',
+}
+-- trace file opened in the append mode, or nil if tracing is disabled
+local FILE
+-- pid of the process that started the tracing
+local PID
+-- pid of the process that wrote the last event
+local LAST_PID
+
+--- quote returns the string as a JSON string
+--- @param s any
+--- @return string
+local function quote(s)
+    s = gsub(tostring(s), '[%c"\\]', function(c)
+        return ESCAPES[c] or format('\\u%04x', c:byte())
+    end)
+    return '"' .. s .. '"'
+end
+
+--- encode_args returns the flat table as a JSON object
+--- @param args table?
+--- @return string
+local function encode_args(args)
+    if not args then
+        return '{}'
+    end
+
+    local list = {}
+    for k, v in pairs(args) do
+        if type(v) == 'number' or type(v) == 'boolean' then
+            list[#list + 1] = quote(k) .. ':' .. tostring(v)
+        else
+            list[#list + 1] = quote(k) .. ':' .. quote(v)
+        end
+    end
+    return '{' .. concat(list, ',') .. '}'
+end
+
+--- write writes the event to the trace file. each event is written by a
+--- single unbuffered write to the file opened in the append mode, so the
+--- forked child processes can write the events to the same file.
+--- @param pid integer
+--- @param event string
+local function write(pid, event)
+    if pid ~= LAST_PID then
+        LAST_PID = pid
+        if pid ~= PID then
+            -- name the track of the forked child process
+            FILE:write(format('{"name":"process_name","ph":"M","pid":%d,' ..
+                                  '"tid":%d,"args":{"name":"worker %d"}},\n',
+                              pid, pid, pid))
+        end
+    end
+    FILE:write(event)
+end
+
+--- start starts writing the trace events to the file in the Chrome trace
+--- event format
+--- @param pathname string
+--- @return boolean ok
+--- @return string? err
+local function start(pathname)
+    if FILE then
+        return false, 'trace is already started'
+    end
+
+    local f, err = open(pathname, 'w')
+    if not f then
+        return false, err
+    end
+    f:write('[\n')
+    f:close()
+    -- reopen in the append mode to share the file with the child processes
+    f, err = open(pathname, 'a')
+    if not f then
+        return false, err
+    end
+    f:setvbuf('no')
+    FILE = f
+    PID = getpid()
+    LAST_PID = PID
+    return true
+end
+
+--- stop writes the last event and closes the trace file
+local function stop()
+    if not FILE or getpid() ~= PID then
+        return
+    end
+    -- the last event has no trailing comma to make the file valid JSON
+    FILE:write(format('{"name":"process_name","ph":"M","pid":%d,"tid":%d,' ..
+                          '"args":{"name":"testcase"}}\n]\n', PID, PID))
+    FILE:close()
+    FILE = nil
+end
+
+--- enabled returns true if the tracing is started
+--- @return boolean
+local function enabled()
+    return FILE ~= nil
+end
+
+--- begin returns a span that starts at the current time, or nil if the
+--- tracing is disabled
+--- @param name string
+--- @param cat string category of the span
+--- @param tid integer? track in the process (default: pid)
+--- @return table? span
+local function begin(name, cat, tid)
+    if FILE then
+        return {
+            name = name,
+            cat = cat,
+            tid = tid,
+            ts = clock(),
+        }
+    end
+end
+
+--- finish writes the span as a complete event
+--- @param span table? span returned by begin
+--- @param args table? flat table of the event arguments
+local function finish(span, args)
+    if not span or not FILE then
+        return
+    end
+    local pid = getpid()
+    write(pid, format('{"name":%s,"cat":%s,"ph":"X","ts":%.3f,"dur":%.3f,' ..
+                          '"pid":%d,"tid":%d,"args":%s},\n',
+                      quote(span.name), quote(span.cat), span.ts / 1000,
+                      (clock() - span.ts) / 1000, pid, span.tid or pid,
+                      encode_args(args)))
+end
+
+return {
+    start = start,
+    stop = stop,
+    enabled = enabled,
+    begin = begin,
+    finish = finish,
+}
@@ -0,0 +1,126 @@
+/**
+ *  Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+#if defined(__linux__)
+// CPU_SET and sched_setaffinity are GNU extensions
+# define _GNU_SOURCE
+# include <sched.h>
+#endif
+#include <errno.h>
+// lua
+#include <lua_errno.h>
+
+#if defined(__linux__)
+
+static int get_lua(lua_State *L)
+{
+    cpu_set_t set = {0};
+    int n         = 0;
+
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "affinity.get");
+        return 2;
+    }
+
+    lua_createtable(L, CPU_COUNT(&set), 0);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            lua_pushinteger(L, cpu);
+            lua_rawseti(L, -2, ++n);
+        }
+    }
+    return 1;
+}
+
+static inline void addcpu(lua_State *L, int idx, cpu_set_t *set)
+{
+    lua_Integer cpu = lua_tointeger(L, idx);
+
+    if (!lua_isnumber(L, idx) || cpu < 0 || cpu >= CPU_SETSIZE) {
+        luaL_argerror(L, 1, "CPU number must be between 0 and CPU_SETSIZE");
+    }
+    CPU_SET(cpu, set);
+}
+
+static int set_lua(lua_State *L)
+{
+    cpu_set_t set = {0};
+
+    CPU_ZERO(&set);
+    if (lua_type(L, 1) == LUA_TTABLE) {
+        int len = lauxh_rawlen(L, 1);
+
+        luaL_argcheck(L, len > 0, 1, "empty table");
+        for (int i = 1; i <= len; i++) {
+            lua_rawgeti(L, 1, i);
+            addcpu(L, -1, &set);
+            lua_pop(L, 1);
+        }
+    } else {
+        luaL_checkinteger(L, 1);
+        addcpu(L, 1, &set);
+    }
+
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, errno, "affinity.set");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+#else
+
+static int get_lua(lua_State *L)
+{
+    lua_pushnil(L);
+    lua_errno_new(L, ENOTSUP, "affinity.get");
+    return 2;
+}
+
+static int set_lua(lua_State *L)
+{
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, ENOTSUP, "affinity.set");
+    return 2;
+}
+
+#endif
+
+LUALIB_API int luaopen_testcase_affinity(lua_State *L)
+{
+    struct luaL_Reg funcs[] = {
+        {"get", get_lua},
+        {"set", set_lua},
+        {NULL,  NULL   }
+    };
+
+    lua_errno_loadlib(L);
+    lua_newtable(L);
+    for (struct luaL_Reg *ptr = funcs; ptr->name; ptr++) {
+        lua_pushcfunction(L, ptr->func);
+        lua_setfield(L, -2, ptr->name);
+    }
+    return 1;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+// lua
+#include <lauxlib.h>
+#include <lualib.h>
+
+/**
+ * the core module contains all native modules in a single shared object to
+ * reduce the number of the shared objects to be loaded at startup.
+ * loading this module registers the loaders of the native modules in
+ * package.preload, so the modules are loaded by the existing names without
+ * searching the separate shared objects.
+ */
+LUALIB_API int luaopen_testcase_affinity(lua_State *L);
+LUALIB_API int luaopen_testcase_chdir(lua_State *L);
+LUALIB_API int luaopen_testcase_close(lua_State *L);
+LUALIB_API int luaopen_testcase_fork(lua_State *L);
+LUALIB_API int luaopen_testcase_fstat(lua_State *L);
+LUALIB_API int luaopen_testcase_fsync(lua_State *L);
+LUALIB_API int luaopen_testcase_getpid(lua_State *L);
+LUALIB_API int luaopen_testcase_icount(lua_State *L);
+LUALIB_API int luaopen_testcase_mkdir(lua_State *L);
+LUALIB_API int luaopen_testcase_nosigpipe(lua_State *L);
+LUALIB_API int luaopen_testcase_poll(lua_State *L);
+LUALIB_API int luaopen_testcase_procinfo(lua_State *L);
+LUALIB_API int luaopen_testcase_readdir(lua_State *L);
+LUALIB_API int luaopen_testcase_realpath(lua_State *L);
+LUALIB_API int luaopen_testcase_record(lua_State *L);
+LUALIB_API int luaopen_testcase_rlimit(lua_State *L);
+LUALIB_API int luaopen_testcase_select(lua_State *L);
+LUALIB_API int luaopen_testcase_shm(lua_State *L);
+LUALIB_API int luaopen_testcase_shutdown(lua_State *L);
+LUALIB_API int luaopen_testcase_socketpair(lua_State *L);
+LUALIB_API int luaopen_testcase_timer(lua_State *L);
+LUALIB_API int luaopen_testcase_tmpdir(lua_State *L);
+LUALIB_API int luaopen_testcase_waitany(lua_State *L);
+LUALIB_API int luaopen_testcase_xpcall(lua_State *L);
+
+LUALIB_API int luaopen_testcase_core(lua_State *L)
+{
+    struct luaL_Reg loaders[] = {
+        {"testcase.affinity",   luaopen_testcase_affinity  },
+        {"testcase.chdir",      luaopen_testcase_chdir     },
+        {"testcase.close",      luaopen_testcase_close     },
+        {"testcase.fork",       luaopen_testcase_fork      },
+        {"testcase.fstat",      luaopen_testcase_fstat     },
+        {"testcase.fsync",      luaopen_testcase_fsync     },
+        {"testcase.getpid",     luaopen_testcase_getpid    },
+        {"testcase.icount",     luaopen_testcase_icount    },
+        {"testcase.mkdir",      luaopen_testcase_mkdir     },
+        {"testcase.nosigpipe",  luaopen_testcase_nosigpipe },
+        {"testcase.poll",       luaopen_testcase_poll      },
+        {"testcase.procinfo",   luaopen_testcase_procinfo  },
+        {"testcase.readdir",    luaopen_testcase_readdir   },
+        {"testcase.realpath",   luaopen_testcase_realpath  },
+        {"testcase.record",     luaopen_testcase_record    },
+        {"testcase.rlimit",     luaopen_testcase_rlimit    },
+        {"testcase.select",     luaopen_testcase_select    },
+        {"testcase.shm",        luaopen_testcase_shm       },
+        {"testcase.shutdown",   luaopen_testcase_shutdown  },
+        {"testcase.socketpair", luaopen_testcase_socketpair},
+        {"testcase.timer",      luaopen_testcase_timer     },
+        {"testcase.tmpdir",     luaopen_testcase_tmpdir    },
+        {"testcase.waitany",    luaopen_testcase_waitany   },
+        {"testcase.xpcall",     luaopen_testcase_xpcall    },
+        {NULL,                  NULL                       }
+    };
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "preload");
+    if (!lua_istable(L, -1)) {
+        return luaL_error(L, "package.preload is not a table");
+    }
+    // returns the table of the loaders that are registered
+    lua_newtable(L);
+    for (struct luaL_Reg *ptr = loaders; ptr->name; ptr++) {
+        lua_getfield(L, -2, ptr->name);
+        if (lua_isnil(L, -1)) {
+            // do not overwrite the loader registered by others
+            lua_pushcfunction(L, ptr->func);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, -5, ptr->name);
+            lua_setfield(L, -3, ptr->name);
+        }
+        lua_pop(L, 1);
+    }
+    return 1;
+}
@@ -21,42 +21,144 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
 // lua
-#include <lauxlib.h>
-#include <lualib.h>
+#include <lua_errno.h>
 
 #define PROC_MT "testcase.process"
 
-static int wait_lua(lua_State *L)
+// milliseconds to wait for the process to terminate after sending SIGTERM
+// before sending SIGKILL on garbage collection
+#ifndef TESTCASE_FORK_GRACE_MSEC
+# define TESTCASE_FORK_GRACE_MSEC 100
+#endif
+
+#define WAIT_OPTIONS (WUNTRACED | WCONTINUED)
+// maximum sleep interval in milliseconds if pidfd is not available
+#define MAX_SLEEP_MSEC 10
+// maximum number of processes to wait for at once
+#define MAX_WAITANY 256
+
+static inline int64_t getmsec(void)
 {
-    pid_t *p    = luaL_checkudata(L, 1, PROC_MT);
-    pid_t pid   = *p;
-    int wstatus = 0;
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + (int64_t)ts.tv_nsec / 1000000;
+}
 
-    if (pid == 0) {
-        return luaL_error(L, "cannot wait for self-process to terminate");
-    } else if (pid < 1) {
-        // already exit
-        errno = ECHILD;
-        lua_pushnil(L);
-        lua_pushstring(L, strerror(errno));
-        lua_pushinteger(L, errno);
-        return 3;
-    } else if (waitpid(pid, &wstatus, WUNTRACED | WCONTINUED) == -1) {
-        // got error
-        lua_pushnil(L);
-        lua_pushstring(L, strerror(errno));
-        lua_pushinteger(L, errno);
-        return 3;
+/**
+ * the waiter blocks until one of the processes terminates. the processes are
+ * not reaped. it uses the pidfds opened once per wait if available, otherwise
+ * it sleeps for a short interval that grows on each call up to
+ * MAX_SLEEP_MSEC.
+ */
+typedef struct {
+    struct pollfd fds[MAX_WAITANY];
+    int nfds;
+    int npid;
+    int fallback;
+    int interval;
+} waiter_t;
+
+static void waiter_open(waiter_t *w, const pid_t *pids, int n)
+{
+    w->nfds     = 0;
+    w->npid     = n;
+    w->fallback = 1;
+    w->interval = 0;
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    w->fallback = 0;
+    for (int i = 0; i < n && i < MAX_WAITANY; i++) {
+        int fd = syscall(SYS_pidfd_open, pids[i], 0);
+        if (fd == -1) {
+            // ESRCH: already reaped, otherwise fallback to sleep
+            w->fallback = errno != ESRCH;
+            break;
+        }
+        w->fds[w->nfds++] = (struct pollfd){.fd = fd, .events = POLLIN};
     }
+#else
+    (void)pids;
+#endif
+}
+
+static void waiter_close(waiter_t *w)
+{
+    for (int i = 0; i < w->nfds; i++) {
+        close(w->fds[i].fd);
+    }
+    w->nfds = 0;
+}
+
+// wait for at most msec milliseconds (msec < 0: no limit)
+static void waiter_wait(waiter_t *w, int msec)
+{
+    if (!w->fallback) {
+        if (w->nfds == w->npid) {
+            poll(w->fds, w->nfds, msec);
+        }
+        return;
+    }
+
+    // sleep with backoff
+    if (w->interval < 1) {
+        w->interval = 1;
+    }
+    if (msec < 0 || msec > w->interval) {
+        msec = w->interval;
+    }
+    nanosleep(&(struct timespec){.tv_sec  = msec / 1000,
+                                 .tv_nsec = (msec % 1000) * 1000000},
+              NULL);
+    if (w->interval < MAX_SLEEP_MSEC) {
+        w->interval *= 2;
+    }
+}
+
+// returns the remaining milliseconds or -1 if no deadline
+static inline int remaining(int64_t deadline)
+{
+    int64_t now = 0;
+
+    if (deadline < 0) {
+        return -1;
+    }
+    now = getmsec();
+    return now < deadline ? (int)(deadline - now) : 0;
+}
+
+static inline int push_error(lua_State *L)
+{
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    lua_pushinteger(L, errno);
+    return 3;
+}
+
+static inline int push_again(lua_State *L)
+{
+    lua_pushnil(L);
+    lua_pushnil(L);
+    lua_pushboolean(L, 1);
+    return 3;
+}
+
+static int push_result(lua_State *L, pid_t *p, int wstatus)
+{
+    pid_t pid = *p;
 
-    // push result
     lua_createtable(L, 0, 5);
     lua_pushinteger(L, pid);
     lua_setfield(L, -2, "pid");
@@ -89,6 +191,154 @@ static int wait_lua(lua_State *L)
     return 1;
 }
 
+/**
+ * get the deadline from the wait option at idx;
+ *  nil: wait without limit
+ *  true: do not wait (WNOHANG)
+ *  number: wait for the specified seconds
+ */
+static inline int64_t checkdeadline(lua_State *L, int idx)
+{
+    switch (lua_type(L, idx)) {
+    case LUA_TNONE:
+    case LUA_TNIL:
+        return -1;
+
+    case LUA_TBOOLEAN:
+        return lua_toboolean(L, idx) ? 0 : -1;
+
+    default: {
+        lua_Number sec = luaL_checknumber(L, idx);
+        luaL_argcheck(L, sec >= 0, idx, "timeout must be >= 0");
+        return getmsec() + (int64_t)(sec * 1000);
+    }
+    }
+}
+
+static int waitany(lua_State *L, waiter_t *w, int n, int64_t deadline)
+{
+    pid_t pids[MAX_WAITANY] = {0};
+    int opened              = 0;
+
+    while (1) {
+        int nwait = 0;
+
+        for (int i = 1; i <= n; i++) {
+            pid_t *p    = NULL;
+            int wstatus = 0;
+            pid_t rv    = 0;
+
+            lua_rawgeti(L, 1, i);
+            p = lua_touserdata(L, -1);
+            if (*p < 1) {
+                // self-process or already exited
+                lua_pop(L, 1);
+                continue;
+            }
+
+            rv = waitpid(*p, &wstatus, WNOHANG | WAIT_OPTIONS);
+            if (rv == -1) {
+                return push_error(L);
+            } else if (rv > 0) {
+                // returns the process and its result
+                push_result(L, p, wstatus);
+                return 2;
+            }
+            pids[nwait++] = *p;
+            lua_pop(L, 1);
+        }
+
+        if (nwait == 0) {
+            errno = ECHILD;
+            return push_error(L);
+        } else if (deadline == 0) {
+            return push_again(L);
+        }
+
+        {
+            int msec = remaining(deadline);
+            if (msec == 0) {
+                return push_again(L);
+            } else if (!opened) {
+                // the waited processes do not change until one of them exits
+                waiter_open(w, pids, nwait);
+                opened = 1;
+            }
+            waiter_wait(w, msec);
+        }
+    }
+}
+
+static int waitany_lua(lua_State *L)
+{
+    int64_t deadline = -1;
+    waiter_t w       = {.nfds = 0};
+    int n            = 0;
+    int rv           = 0;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    deadline = checkdeadline(L, 2);
+    n        = lauxh_rawlen(L, 1);
+    luaL_argcheck(L, n <= MAX_WAITANY, 1, "too many processes");
+    lua_settop(L, 1);
+    // verify the list
+    for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, 1, i);
+        luaL_checkudata(L, -1, PROC_MT);
+        lua_pop(L, 1);
+    }
+
+    rv = waitany(L, &w, n, deadline);
+    waiter_close(&w);
+    return rv;
+}
+
+static int wait_lua(lua_State *L)
+{
+    pid_t *p         = luaL_checkudata(L, 1, PROC_MT);
+    pid_t pid        = *p;
+    int64_t deadline = checkdeadline(L, 2);
+    waiter_t w       = {.nfds = 0};
+    int wstatus      = 0;
+
+    if (pid == 0) {
+        return luaL_error(L, "cannot wait for self-process to terminate");
+    } else if (pid < 1) {
+        // already exit
+        errno = ECHILD;
+        return push_error(L);
+    } else if (deadline < 0) {
+        if (waitpid(pid, &wstatus, WAIT_OPTIONS) == -1) {
+            // got error
+            return push_error(L);
+        }
+        return push_result(L, p, wstatus);
+    }
+
+    waiter_open(&w, &pid, 1);
+    while (1) {
+        int msec = 0;
+
+        switch (waitpid(pid, &wstatus, WNOHANG | WAIT_OPTIONS)) {
+        case -1:
+            waiter_close(&w);
+            return push_error(L);
+        case 0:
+            break;
+        default:
+            waiter_close(&w);
+            return push_result(L, p, wstatus);
+        }
+
+        msec = remaining(deadline);
+        if (msec == 0) {
+            waiter_close(&w);
+            return push_again(L);
+        }
+        waiter_wait(&w, msec);
+    }
+}
+
 static int is_child_lua(lua_State *L)
 {
     pid_t *p = luaL_checkudata(L, 1, PROC_MT);
@@ -110,11 +360,25 @@ static int gc_lua(lua_State *L)
 
     if (pid == 0) {
         exit(EXIT_SUCCESS);
-    } else if (pid > 1) {
-        // kill process
-        if (waitpid(pid, NULL, WNOHANG) == 0 && kill(pid, SIGKILL) == 0) {
-            waitpid(pid, NULL, 0);
+    } else if (pid > 1 && waitpid(pid, NULL, WNOHANG) == 0 &&
+               kill(pid, SIGTERM) == 0) {
+        // terminate process gracefully, then kill it if it does not exit
+        int64_t deadline = getmsec() + TESTCASE_FORK_GRACE_MSEC;
+        waiter_t w       = {.nfds = 0};
+        int msec         = 0;
+
+        waiter_open(&w, &pid, 1);
+        while (waitpid(pid, NULL, WNOHANG) == 0) {
+            msec = remaining(deadline);
+            if (msec == 0) {
+                if (kill(pid, SIGKILL) == 0) {
+                    waitpid(pid, NULL, 0);
+                }
+                break;
+            }
+            waiter_wait(&w, msec);
         }
+        waiter_close(&w);
     }
 
     return 0;
@@ -152,7 +416,7 @@ static int fork_lua(lua_State *L)
     return 1;
 }
 
-LUALIB_API int luaopen_testcase_fork(lua_State *L)
+static void create_metatable(lua_State *L)
 {
     struct luaL_Reg mmethod[] = {
         {"__gc", gc_lua},
@@ -166,7 +430,10 @@ LUALIB_API int luaopen_testcase_fork(lua_State *L)
     };
 
     // create metatable
-    luaL_newmetatable(L, PROC_MT);
+    if (!luaL_newmetatable(L, PROC_MT)) {
+        lua_pop(L, 1);
+        return;
+    }
     // metamethods
     for (struct luaL_Reg *ptr = mmethod; ptr->name; ptr++) {
         lua_pushstring(L, ptr->name);
@@ -183,7 +450,18 @@ LUALIB_API int luaopen_testcase_fork(lua_State *L)
     }
     lua_rawset(L, -3);
     lua_pop(L, 1);
+}
 
+LUALIB_API int luaopen_testcase_fork(lua_State *L)
+{
+    create_metatable(L);
     lua_pushcfunction(L, fork_lua);
     return 1;
 }
+
+LUALIB_API int luaopen_testcase_waitany(lua_State *L)
+{
+    create_metatable(L);
+    lua_pushcfunction(L, waitany_lua);
+    return 1;
+}
@@ -0,0 +1,141 @@
+/**
+ *  Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+#include <stdint.h>
+// lua
+#include <lauxlib.h>
+#include <lualib.h>
+
+/**
+ * the count hook is called for every VM instruction, and the call hook is
+ * called for every function call to count the calls of the C functions.
+ * the numbers do not depend on the speed of the machine, but the hooks are
+ * only set to the running thread, and the compiled code of LuaJIT is not
+ * counted.
+ *
+ * the hook that was set before (e.g. luacov) is chained; its events are
+ * added to the mask and passed to it, and its count events are emulated by
+ * counting down the instructions.
+ */
+typedef struct {
+    lua_Hook hook;
+    int mask;
+    int count;
+    int left;
+} prevhook_t;
+
+static uint64_t NINSTR = 0;
+static uint64_t NCCALL = 0;
+static prevhook_t PREV = {0};
+
+static void count_hook(lua_State *L, lua_Debug *ar)
+{
+    int event = ar->event;
+
+    if (event == LUA_HOOKCOUNT) {
+        NINSTR++;
+        if (!(PREV.mask & LUA_MASKCOUNT) || --PREV.left > 0) {
+            return;
+        }
+        PREV.left = PREV.count;
+    } else if (event == LUA_HOOKCALL
+#ifdef LUA_HOOKTAILCALL
+               || event == LUA_HOOKTAILCALL
+#endif
+    ) {
+        if (lua_getinfo(L, "S", ar) && *ar->what == 'C') {
+            NCCALL++;
+        }
+        if (!(PREV.mask & LUA_MASKCALL)) {
+            return;
+        }
+    }
+    // the line and return events are requested only by the previous hook
+    if (PREV.hook) {
+        PREV.hook(L, ar);
+    }
+}
+
+static int measure_lua(lua_State *L)
+{
+    lua_Hook prev_hook    = lua_gethook(L);
+    int prev_mask         = lua_gethookmask(L);
+    int prev_count        = lua_gethookcount(L);
+    prevhook_t outer_prev = PREV;
+    uint64_t outer[2]     = {NINSTR, NCCALL};
+    uint64_t ninstr       = 0;
+    uint64_t nccall       = 0;
+    int rc                = 0;
+
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    // capture the stack frames at the error by the message handler of
+    // testcase.xpcall
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    NINSTR = 0;
+    NCCALL = 0;
+    // the nested measurement keeps chaining to the hook of the outer one
+    if (prev_hook != count_hook) {
+        PREV = (prevhook_t){
+            .hook  = prev_hook,
+            .mask  = prev_mask,
+            .count = prev_count,
+            .left  = prev_count,
+        };
+    }
+    lua_sethook(L, count_hook, LUA_MASKCOUNT | LUA_MASKCALL | PREV.mask, 1);
+    rc = lua_pcall(L, lua_gettop(L) - 2, 0, 1);
+    lua_sethook(L, prev_hook, prev_mask, prev_count);
+    PREV = outer_prev;
+    ninstr = NINSTR;
+    nccall = NCCALL;
+    // the nested measurement is included in the outer measurement
+    NINSTR = outer[0] + ninstr;
+    NCCALL = outer[1] + nccall;
+    if (rc != 0) {
+        // rethrow the captured error object
+        return lua_error(L);
+    }
+
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, (lua_Number)ninstr);
+    lua_setfield(L, -2, "instructions");
+    lua_pushnumber(L, (lua_Number)nccall);
+    lua_setfield(L, -2, "ccalls");
+    return 1;
+}
+
+LUALIB_API int luaopen_testcase_icount(lua_State *L)
+{
+    // testcase.xpcall registers its message handler when it is loaded
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "testcase.xpcall");
+    lua_call(L, 1, 0);
+
+    lua_newtable(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, "testcase.xpcall.capture");
+    if (!lua_isfunction(L, -1)) {
+        return luaL_error(L, "testcase.xpcall.capture is not a function");
+    }
+    lua_pushcclosure(L, measure_lua, 1);
+    lua_setfield(L, -2, "measure");
+    return 1;
+}
@@ -0,0 +1,606 @@
+/**
+ * Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+# define USE_EPOLL
+# include <sys/epoll.h>
+# include <sys/syscall.h>
+#endif
+// lua
+#include <lua_errno.h>
+
+#define MODULE_MT "testcase.poll"
+
+#define EV_READ  0x1
+#define EV_WRITE 0x2
+
+// maximum wait time in milliseconds to check the exit of child processes
+// that cannot be watched by pidfd
+#define PROC_CHECK_MSEC 10
+
+typedef struct {
+    // epoll descriptor
+    int fd;
+    // reference of the watch list table
+    int ref;
+} testcase_poll_t;
+
+// the watch list table;
+//
+// {
+//     fds = {
+//         [<fd>] = {
+//             ident = <watched object>,
+//             events = <EV_READ|EV_WRITE>,
+//             pid = <pid if fd is a pidfd>,
+//         },
+//     },
+//     pids = {
+//         [<pid>] = <pidfd or false if pidfd is not available>,
+//     },
+//     procs = {
+//         [<pid>] = <watched object>,
+//     }
+// }
+
+static inline uint64_t getmsec(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline int pidfd_open_ex(pid_t pid)
+{
+#if defined(USE_EPOLL) && defined(SYS_pidfd_open)
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd != -1) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// check whether the child process has exited without reaping it
+static inline int is_exited(pid_t pid)
+{
+    siginfo_t info = {0};
+
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
+        // ECHILD: already reaped or not a child
+        return errno == ECHILD;
+    }
+    return info.si_pid == pid;
+}
+
+// get the integer value returned by the method of the object at idx
+static inline lua_Integer checkident(lua_State *L, int idx, const char *method)
+{
+    lua_Integer v = 0;
+
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+        return lua_tointeger(L, idx);
+    }
+
+    lua_getfield(L, idx, method);
+    if (!lua_isfunction(L, -1)) {
+        luaL_argerror(L, idx,
+                      lua_pushfstring(L,
+                                      "integer or object with %s() method "
+                                      "expected, got %s",
+                                      method, luaL_typename(L, idx)));
+    }
+    lua_pushvalue(L, idx);
+    lua_call(L, 1, 1);
+    if (lua_type(L, -1) != LUA_TNUMBER) {
+        luaL_argerror(L, idx,
+                      lua_pushfstring(L, "%s() returns non-integer value",
+                                      method));
+    }
+    v = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+
+static inline testcase_poll_t *checkpoll(lua_State *L)
+{
+    testcase_poll_t *p = luaL_checkudata(L, 1, MODULE_MT);
+    if (p->ref == LUA_NOREF) {
+        luaL_error(L, "attempt to use a closed " MODULE_MT);
+    }
+    return p;
+}
+
+// push the watch list field table
+static inline void getlist(lua_State *L, testcase_poll_t *p, const char *name)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, p->ref);
+    lua_getfield(L, -1, name);
+    lua_replace(L, -2);
+}
+
+static int ctl_fd(testcase_poll_t *p, int op, int fd, int events)
+{
+#if defined(USE_EPOLL)
+    struct epoll_event ev = {
+        .events  = ((events & EV_READ) ? EPOLLIN : 0) |
+                   ((events & EV_WRITE) ? EPOLLOUT : 0),
+        .data.fd = fd,
+    };
+    return epoll_ctl(p->fd, op, fd, &ev);
+#else
+    // poll(2) backend uses the watch list only
+    (void)p;
+    (void)op;
+    (void)events;
+    if (fcntl(fd, F_GETFD) == -1) {
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+#if !defined(USE_EPOLL)
+# define EPOLL_CTL_ADD 1
+# define EPOLL_CTL_MOD 2
+# define EPOLL_CTL_DEL 3
+#endif
+
+static int add_fd(lua_State *L, testcase_poll_t *p, int fd, int events,
+                  int ident_idx, pid_t pid)
+{
+    int op = EPOLL_CTL_ADD;
+
+    getlist(L, p, "fds");
+    lua_rawgeti(L, -1, fd);
+    if (!lua_isnil(L, -1)) {
+        op = EPOLL_CTL_MOD;
+    }
+    lua_pop(L, 1);
+
+    if (ctl_fd(p, op, fd, events) == -1 &&
+        // the descriptor was closed without del() and its number is reused
+        (op != EPOLL_CTL_MOD || errno != ENOENT ||
+         ctl_fd(p, EPOLL_CTL_ADD, fd, events) == -1)) {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+
+    lua_createtable(L, 0, 3);
+    lua_pushvalue(L, ident_idx);
+    lua_setfield(L, -2, "ident");
+    lua_pushinteger(L, events);
+    lua_setfield(L, -2, "events");
+    if (pid > 0) {
+        lua_pushinteger(L, pid);
+        lua_setfield(L, -2, "pid");
+    }
+    lua_rawseti(L, -2, fd);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int del_fd(lua_State *L, testcase_poll_t *p, int fd)
+{
+    getlist(L, p, "fds");
+    lua_rawgeti(L, -1, fd);
+    if (lua_isnil(L, -1)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, fd);
+    // ignore error; the descriptor may have already been closed
+    ctl_fd(p, EPOLL_CTL_DEL, fd, 0);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int delproc_lua(lua_State *L)
+{
+    testcase_poll_t *p = checkpoll(L);
+    pid_t pid          = checkident(L, 2, "pid");
+    int pidfd          = -1;
+
+    lua_settop(L, 2);
+    getlist(L, p, "pids");
+    lua_rawgeti(L, -1, pid);
+    if (lua_isnil(L, -1)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    } else if (lua_type(L, -1) == LUA_TNUMBER) {
+        pidfd = lua_tointeger(L, -1);
+    }
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, pid);
+
+    if (pidfd != -1) {
+        del_fd(L, p, pidfd);
+        close(pidfd);
+    } else {
+        getlist(L, p, "procs");
+        lua_pushnil(L);
+        lua_rawseti(L, -2, pid);
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int addproc_lua(lua_State *L)
+{
+    testcase_poll_t *p = checkpoll(L);
+    pid_t pid          = checkident(L, 2, "pid");
+    int pidfd          = -1;
+
+    luaL_argcheck(L, pid > 0, 2, "pid must be greater than 0");
+    lua_settop(L, 2);
+    getlist(L, p, "pids");
+    lua_rawgeti(L, -1, pid);
+    if (!lua_isnil(L, -1)) {
+        // already watched
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+    lua_pop(L, 1);
+
+    pidfd = pidfd_open_ex(pid);
+    if (pidfd != -1) {
+        int rv = add_fd(L, p, pidfd, EV_READ, 2, pid);
+        if (rv != 1) {
+            close(pidfd);
+            return rv;
+        }
+        lua_pushinteger(L, pidfd);
+        lua_rawseti(L, 3, pid);
+    } else if (errno == ESRCH) {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    } else {
+        // fallback to waitid(2) polling
+        lua_pushboolean(L, 0);
+        lua_rawseti(L, 3, pid);
+        getlist(L, p, "procs");
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, pid);
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int del_lua(lua_State *L)
+{
+    testcase_poll_t *p = checkpoll(L);
+    int fd             = checkident(L, 2, "fd");
+
+    lua_settop(L, 2);
+    return del_fd(L, p, fd);
+}
+
+static int add_lua(lua_State *L)
+{
+    static const char *const opts[] = {"r", "w", "rw", NULL};
+    static const int events[]       = {EV_READ, EV_WRITE, EV_READ | EV_WRITE};
+    testcase_poll_t *p              = checkpoll(L);
+    int fd                          = checkident(L, 2, "fd");
+    int ev                          = events[luaL_checkoption(L, 3, "r", opts)];
+
+    lua_settop(L, 3);
+    return add_fd(L, p, fd, ev, 2, 0);
+}
+
+// push an event table for the watch list entry at the top of the stack
+static void push_event(lua_State *L, int tbl, int readable, int writable,
+                       int hup, int err)
+{
+    lua_createtable(L, 0, 4);
+    lua_getfield(L, -2, "ident");
+    lua_setfield(L, -2, "ident");
+    lua_getfield(L, -2, "pid");
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        if (readable) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "readable");
+        }
+        if (writable) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "writable");
+        }
+        if (hup) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "hup");
+        }
+        if (err) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "error");
+        }
+    } else {
+        lua_setfield(L, -2, "pid");
+        lua_pushboolean(L, 1);
+        lua_setfield(L, -2, "exited");
+    }
+    lua_rawseti(L, tbl, lauxh_rawlen(L, tbl) + 1);
+}
+
+// wait for the events of the descriptors and push them to the table at tbl
+static int wait_fds(lua_State *L, testcase_poll_t *p, int tbl, int msec)
+{
+#if defined(USE_EPOLL)
+    struct epoll_event evs[64] = {0};
+    int n = epoll_wait(p->fd, evs, sizeof(evs) / sizeof(evs[0]), msec);
+
+    if (n == -1) {
+        return -1;
+    }
+    getlist(L, p, "fds");
+    for (int i = 0; i < n; i++) {
+        uint32_t ev = evs[i].events;
+        lua_rawgeti(L, -1, evs[i].data.fd);
+        if (!lua_isnil(L, -1)) {
+            push_event(L, tbl, ev & EPOLLIN, ev & EPOLLOUT, ev & EPOLLHUP,
+                       ev & EPOLLERR);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return n;
+
+#else
+    struct pollfd *fds = NULL;
+    nfds_t nfds        = 0;
+    nfds_t i           = 0;
+    int n              = 0;
+
+    getlist(L, p, "fds");
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        nfds++;
+        lua_pop(L, 1);
+    }
+    if (nfds) {
+        fds = lua_newuserdata(L, sizeof(struct pollfd) * nfds);
+        lua_insert(L, -2);
+    }
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        int events = 0;
+        lua_getfield(L, -1, "events");
+        events = lua_tointeger(L, -1);
+        lua_pop(L, 2);
+        fds[i++] = (struct pollfd){
+            .fd      = lua_tointeger(L, -1),
+            .events  = ((events & EV_READ) ? POLLIN : 0) |
+                       ((events & EV_WRITE) ? POLLOUT : 0),
+            .revents = 0,
+        };
+    }
+
+    n = poll(fds, nfds, msec);
+    if (n > 0) {
+        for (i = 0; i < nfds; i++) {
+            short ev = fds[i].revents;
+            if (ev) {
+                lua_rawgeti(L, -1, fds[i].fd);
+                push_event(L, tbl, ev & POLLIN, ev & POLLOUT, ev & POLLHUP,
+                           ev & (POLLERR | POLLNVAL));
+                lua_pop(L, 1);
+            }
+        }
+    }
+    lua_pop(L, nfds ? 2 : 1);
+    return n;
+#endif
+}
+
+// push the exit events of the processes that are not watched by pidfd
+static int check_procs(lua_State *L, testcase_poll_t *p, int tbl, int *nproc)
+{
+    int n = 0;
+
+    *nproc = 0;
+    getlist(L, p, "procs");
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        pid_t pid = lua_tointeger(L, -2);
+        *nproc += 1;
+        if (is_exited(pid)) {
+            lua_createtable(L, 0, 3);
+            lua_pushvalue(L, -2);
+            lua_setfield(L, -2, "ident");
+            lua_pushinteger(L, pid);
+            lua_setfield(L, -2, "pid");
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "exited");
+            lua_rawseti(L, tbl, lauxh_rawlen(L, tbl) + 1);
+            n++;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return n;
+}
+
+static int wait_lua(lua_State *L)
+{
+    testcase_poll_t *p = checkpoll(L);
+    lua_Number sec     = luaL_optnumber(L, 2, -1);
+    // the timeout that cannot be represented in msec is treated as infinite
+    int infinite       = sec < 0 || sec * 1000 >= (lua_Number)INT64_MAX;
+    uint64_t deadline  = getmsec() + (infinite ? 0 : (uint64_t)(sec * 1000));
+    int tbl            = 0;
+
+    lua_settop(L, 1);
+    lua_newtable(L);
+    tbl = lua_gettop(L);
+
+    while (1) {
+        int nproc = 0;
+        int msec  = -1;
+        int n     = check_procs(L, p, tbl, &nproc);
+
+        if (n) {
+            // collect the ready descriptors without blocking
+            msec = 0;
+        } else if (!infinite) {
+            uint64_t now = getmsec();
+            if (now >= deadline) {
+                msec = 0;
+            } else if (deadline - now > INT_MAX) {
+                msec = INT_MAX;
+            } else {
+                msec = (int)(deadline - now);
+            }
+        }
+        if (nproc && (msec < 0 || msec > PROC_CHECK_MSEC)) {
+            msec = PROC_CHECK_MSEC;
+        }
+
+        if (wait_fds(L, p, tbl, msec) == -1 && errno != EINTR) {
+            lua_pushnil(L);
+            lua_pushstring(L, strerror(errno));
+            return 2;
+        } else if (lauxh_rawlen(L, tbl) > 0 ||
+                   (!infinite && getmsec() >= deadline)) {
+            return 1;
+        }
+    }
+}
+
+static int close_lua(lua_State *L)
+{
+    testcase_poll_t *p = luaL_checkudata(L, 1, MODULE_MT);
+
+    if (p->ref != LUA_NOREF) {
+        // close pidfds
+        getlist(L, p, "pids");
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            if (lua_type(L, -1) == LUA_TNUMBER) {
+                close(lua_tointeger(L, -1));
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+        luaL_unref(L, LUA_REGISTRYINDEX, p->ref);
+        p->ref = LUA_NOREF;
+    }
+    if (p->fd != -1) {
+        close(p->fd);
+        p->fd = -1;
+    }
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    lua_pushfstring(L, MODULE_MT ": %p", lua_touserdata(L, 1));
+    return 1;
+}
+
+static int new_lua(lua_State *L)
+{
+    testcase_poll_t *p = lua_newuserdata(L, sizeof(testcase_poll_t));
+
+    *p = (testcase_poll_t){.fd = -1, .ref = LUA_NOREF};
+#if defined(USE_EPOLL)
+    p->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (p->fd == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+#endif
+    luaL_getmetatable(L, MODULE_MT);
+    lua_setmetatable(L, -2);
+
+    // create watch list
+    lua_createtable(L, 0, 3);
+    lua_newtable(L);
+    lua_setfield(L, -2, "fds");
+    lua_newtable(L);
+    lua_setfield(L, -2, "pids");
+    lua_newtable(L);
+    lua_setfield(L, -2, "procs");
+    p->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return 1;
+}
+
+LUALIB_API int luaopen_testcase_poll(lua_State *L)
+{
+    // create metatable
+    if (luaL_newmetatable(L, MODULE_MT)) {
+        struct luaL_Reg mmethod[] = {
+            {"__gc",       close_lua   },
+            {"__tostring", tostring_lua},
+            {NULL,         NULL        }
+        };
+        struct luaL_Reg method[] = {
+            {"add",     add_lua    },
+            {"del",     del_lua    },
+            {"addproc", addproc_lua},
+            {"delproc", delproc_lua},
+            {"wait",    wait_lua   },
+            {"close",   close_lua  },
+            {NULL,      NULL       }
+        };
+
+        // metamethods
+        for (struct luaL_Reg *ptr = mmethod; ptr->name; ptr++) {
+            lua_pushcfunction(L, ptr->func);
+            lua_setfield(L, -2, ptr->name);
+        }
+        // methods
+        lua_newtable(L);
+        for (struct luaL_Reg *ptr = method; ptr->name; ptr++) {
+            lua_pushcfunction(L, ptr->func);
+            lua_setfield(L, -2, ptr->name);
+        }
+        lua_setfield(L, -2, "__index");
+    }
+    lua_settop(L, 0);
+
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, new_lua);
+    lua_setfield(L, -2, "new");
+    return 1;
+}
@@ -0,0 +1,212 @@
+/**
+ *  Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+// lua
+#include <lua_errno.h>
+
+// upper bound of the descriptors scanned without /proc/self/fd
+#define MAX_SCANFD 65536
+
+static const char *modetype(mode_t mode)
+{
+    switch (mode & S_IFMT) {
+    case S_IFREG:
+        return "file";
+    case S_IFDIR:
+        return "directory";
+    case S_IFLNK:
+        return "symlink";
+    case S_IFCHR:
+        return "character_device";
+    case S_IFBLK:
+        return "block_device";
+    case S_IFSOCK:
+        return "socket";
+    case S_IFIFO:
+        return "fifo";
+    default:
+        return "unknown";
+    }
+}
+
+// pushes the information of the descriptor to the table at the top of the
+// stack. the descriptor that has been closed in the meantime is ignored.
+static void pushfdinfo(lua_State *L, int fd)
+{
+    struct stat buf = {0};
+
+    if (fstat(fd, &buf) == -1) {
+        return;
+    }
+
+    lua_createtable(L, 0, 2);
+    lauxh_pushstr2tbl(L, "type", modetype(buf.st_mode));
+#if defined(__linux__)
+    {
+        char link[64]       = {0};
+        char path[PATH_MAX] = {0};
+        ssize_t len         = 0;
+
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+        len = readlink(link, path, sizeof(path) - 1);
+        if (len > 0) {
+            lua_pushlstring(L, path, len);
+            lua_setfield(L, -2, "path");
+        }
+    }
+#endif
+    lua_rawseti(L, -2, fd);
+}
+
+static int fds_lua(lua_State *L)
+{
+#if defined(__linux__)
+    DIR *dir = opendir("/proc/self/fd");
+
+    if (dir) {
+        lua_newtable(L);
+        errno = 0;
+        for (struct dirent *entry = readdir(dir); entry;
+             entry = readdir(dir)) {
+            int fd = 0;
+
+            if (!isdigit((unsigned char)entry->d_name[0])) {
+                continue;
+            }
+            fd = atoi(entry->d_name);
+            // ignore the descriptor of the directory stream itself
+            if (fd != dirfd(dir)) {
+                pushfdinfo(L, fd);
+            }
+            errno = 0;
+        }
+        if (errno) {
+            int err = errno;
+            closedir(dir);
+            lua_pushnil(L);
+            lua_errno_new(L, err, "procinfo.fds");
+            return 2;
+        }
+        closedir(dir);
+        return 1;
+    }
+#endif
+
+    // scan the descriptors if /proc is not available
+    {
+        long maxfd = sysconf(_SC_OPEN_MAX);
+
+        if (maxfd < 0 || maxfd > MAX_SCANFD) {
+            maxfd = MAX_SCANFD;
+        }
+        lua_newtable(L);
+        for (int fd = 0; fd < maxfd; fd++) {
+            if (fcntl(fd, F_GETFD) != -1) {
+                pushfdinfo(L, fd);
+            }
+        }
+    }
+    return 1;
+}
+
+static int children_lua(lua_State *L)
+{
+#if defined(__linux__)
+    pid_t self = getpid();
+    DIR *dir   = opendir("/proc");
+    int n      = 0;
+
+    if (!dir) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "procinfo.children");
+        return 2;
+    }
+
+    lua_newtable(L);
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+        char path[64]  = {0};
+        char buf[512]  = {0};
+        char *comm_end = NULL;
+        char state     = 0;
+        int ppid       = 0;
+        FILE *fp       = NULL;
+        size_t len     = 0;
+
+        if (!isdigit((unsigned char)entry->d_name[0])) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+        if (!(fp = fopen(path, "r"))) {
+            // the process has exited in the meantime
+            continue;
+        }
+        len = fread(buf, 1, sizeof(buf) - 1, fp);
+        fclose(fp);
+        buf[len] = 0;
+
+        // <pid> (<comm>) <state> <ppid> ...; comm may contain ')'
+        comm_end = strrchr(buf, ')');
+        if (!comm_end || sscanf(comm_end + 1, " %c %d", &state, &ppid) != 2 ||
+            ppid != self) {
+            continue;
+        }
+
+        lua_createtable(L, 0, 2);
+        lauxh_pushint2tbl(L, "pid", atoi(entry->d_name));
+        lauxh_pushstr2tbl(L, "state", state == 'Z' ? "zombie" : "running");
+        lua_rawseti(L, -2, ++n);
+    }
+    closedir(dir);
+    return 1;
+#else
+    lua_pushnil(L);
+    lua_errno_new(L, ENOTSUP, "procinfo.children");
+    return 2;
+#endif
+}
+
+LUALIB_API int luaopen_testcase_procinfo(lua_State *L)
+{
+    struct luaL_Reg funcs[] = {
+        {"fds",      fds_lua     },
+        {"children", children_lua},
+        {NULL,       NULL        }
+    };
+
+    lua_errno_loadlib(L);
+    lua_newtable(L);
+    for (struct luaL_Reg *ptr = funcs; ptr->name; ptr++) {
+        lua_pushcfunction(L, ptr->func);
+        lua_setfield(L, -2, ptr->name);
+    }
+    return 1;
+}
@@ -0,0 +1,376 @@
+/**
+ * Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+// lua
+#include <lauxlib.h>
+#include <lualib.h>
+
+/**
+ * record format
+ *
+ * a record is a 4-byte big-endian length of the payload followed by the
+ * payload. the payload is a table value, and each value is encoded as a
+ * 1-byte tag followed by its body;
+ *
+ *  'F' / 'T': false / true
+ *  'i': 8-byte big-endian two's complement integer
+ *  'd': 8-byte big-endian IEEE 754 double
+ *  's': 4-byte big-endian length followed by the bytes
+ *  't': 4-byte big-endian number of pairs followed by the key-value pairs
+ */
+#define RECORD_HDRLEN   4
+#define RECORD_MAXDEPTH 32
+// integral doubles in this range are encoded as integers
+#define MAX_SAFE_INTEGER 9007199254740992.0
+
+#define TAG_FALSE   'F'
+#define TAG_TRUE    'T'
+#define TAG_INTEGER 'i'
+#define TAG_DOUBLE  'd'
+#define TAG_STRING  's'
+#define TAG_TABLE   't'
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    // error message of the encoder
+    const char *err;
+    // type name of the value that cannot be encoded
+    const char *type;
+} buffer_t;
+
+static int reserve(buffer_t *b, size_t size)
+{
+    if (b->cap - b->len < size) {
+        size_t cap = b->cap ? b->cap : 256;
+        char *data = NULL;
+
+        while (cap - b->len < size) {
+            cap *= 2;
+        }
+        if (!(data = realloc(b->data, cap))) {
+            b->err = "not enough memory";
+            return -1;
+        }
+        b->data = data;
+        b->cap  = cap;
+    }
+    return 0;
+}
+
+static inline void put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static inline uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+           (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static inline void put_u64(unsigned char *p, uint64_t v)
+{
+    put_u32(p, (uint32_t)(v >> 32));
+    put_u32(p + 4, (uint32_t)v);
+}
+
+static inline uint64_t get_u64(const unsigned char *p)
+{
+    return (uint64_t)get_u32(p) << 32 | get_u32(p + 4);
+}
+
+static int put_tag(buffer_t *b, char tag, size_t size)
+{
+    if (reserve(b, 1 + size) != 0) {
+        return -1;
+    }
+    b->data[b->len++] = tag;
+    return 0;
+}
+
+static int encode_value(lua_State *L, buffer_t *b, int idx, int depth);
+
+static int encode_table(lua_State *L, buffer_t *b, int idx, int depth)
+{
+    size_t pos      = 0;
+    uint32_t npairs = 0;
+
+    if (depth > RECORD_MAXDEPTH) {
+        b->err = "table is nested too deeply";
+        return -1;
+    } else if (put_tag(b, TAG_TABLE, 4) != 0) {
+        return -1;
+    }
+    // the number of pairs is written after the pairs are encoded
+    pos = b->len;
+    b->len += 4;
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        if (encode_value(L, b, lua_gettop(L) - 1, depth) != 0 ||
+            encode_value(L, b, lua_gettop(L), depth) != 0) {
+            lua_pop(L, 2);
+            return -1;
+        }
+        lua_pop(L, 1);
+        npairs++;
+    }
+    put_u32((unsigned char *)b->data + pos, npairs);
+
+    return 0;
+}
+
+static int encode_value(lua_State *L, buffer_t *b, int idx, int depth)
+{
+    switch (lua_type(L, idx)) {
+    case LUA_TBOOLEAN:
+        return put_tag(b, lua_toboolean(L, idx) ? TAG_TRUE : TAG_FALSE, 0);
+
+    case LUA_TNUMBER: {
+        lua_Number n = lua_tonumber(L, idx);
+        uint64_t v   = 0;
+
+        if (put_tag(b, TAG_INTEGER, 8) != 0) {
+            return -1;
+        }
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, idx)) {
+            v = (uint64_t)lua_tointeger(L, idx);
+        } else if (n == floor(n) && fabs(n) <= MAX_SAFE_INTEGER) {
+#else
+        if (n == floor(n) && fabs(n) <= MAX_SAFE_INTEGER) {
+#endif
+            v = (uint64_t)(int64_t)n;
+        } else {
+            b->data[b->len - 1] = TAG_DOUBLE;
+            memcpy(&v, &n, sizeof(v));
+        }
+        put_u64((unsigned char *)b->data + b->len, v);
+        b->len += 8;
+        return 0;
+    }
+
+    case LUA_TSTRING: {
+        size_t len      = 0;
+        const char *str = lua_tolstring(L, idx, &len);
+
+        if (len > UINT32_MAX) {
+            b->err = "string is too long";
+            return -1;
+        } else if (put_tag(b, TAG_STRING, 4 + len) != 0) {
+            return -1;
+        }
+        put_u32((unsigned char *)b->data + b->len, (uint32_t)len);
+        memcpy(b->data + b->len + 4, str, len);
+        b->len += 4 + len;
+        return 0;
+    }
+
+    case LUA_TTABLE:
+        if (!lua_checkstack(L, 3)) {
+            b->err = "stack overflow";
+            return -1;
+        }
+        return encode_table(L, b, idx, depth + 1);
+
+    default:
+        b->type = lua_typename(L, lua_type(L, idx));
+        return -1;
+    }
+}
+
+static int encode_lua(lua_State *L)
+{
+    buffer_t b = {0};
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+    if (reserve(&b, RECORD_HDRLEN) == 0) {
+        b.len = RECORD_HDRLEN;
+        if (encode_table(L, &b, 1, 1) == 0 &&
+            b.len - RECORD_HDRLEN > UINT32_MAX) {
+            b.err = "record is too large";
+        }
+    }
+
+    if (b.type) {
+        free(b.data);
+        return luaL_error(L, "cannot encode a %s value", b.type);
+    } else if (b.err) {
+        free(b.data);
+        return luaL_error(L, "cannot encode a record: %s", b.err);
+    }
+    put_u32((unsigned char *)b.data, (uint32_t)(b.len - RECORD_HDRLEN));
+    lua_pushlstring(L, b.data, b.len);
+    free(b.data);
+
+    return 1;
+}
+
+typedef struct {
+    const unsigned char *cur;
+    const unsigned char *end;
+} reader_t;
+
+static int decode_value(lua_State *L, reader_t *r, int depth)
+{
+    unsigned char tag = 0;
+
+    if (r->cur >= r->end || !lua_checkstack(L, 3)) {
+        return -1;
+    }
+    tag = *r->cur++;
+    switch (tag) {
+    case TAG_FALSE:
+    case TAG_TRUE:
+        lua_pushboolean(L, tag == TAG_TRUE);
+        return 0;
+
+    case TAG_INTEGER:
+    case TAG_DOUBLE: {
+        uint64_t v = 0;
+
+        if (r->end - r->cur < 8) {
+            return -1;
+        }
+        v = get_u64(r->cur);
+        r->cur += 8;
+        if (tag == TAG_INTEGER) {
+#if LUA_VERSION_NUM >= 503
+            lua_pushinteger(L, (lua_Integer)(int64_t)v);
+#else
+            lua_pushnumber(L, (lua_Number)(int64_t)v);
+#endif
+        } else {
+            double n = 0;
+            memcpy(&n, &v, sizeof(n));
+            lua_pushnumber(L, n);
+        }
+        return 0;
+    }
+
+    case TAG_STRING: {
+        uint32_t len = 0;
+
+        if (r->end - r->cur < 4) {
+            return -1;
+        }
+        len = get_u32(r->cur);
+        r->cur += 4;
+        if ((size_t)(r->end - r->cur) < len) {
+            return -1;
+        }
+        lua_pushlstring(L, (const char *)r->cur, len);
+        r->cur += len;
+        return 0;
+    }
+
+    case TAG_TABLE: {
+        uint32_t npairs = 0;
+
+        if (depth > RECORD_MAXDEPTH || r->end - r->cur < 4) {
+            return -1;
+        }
+        npairs = get_u32(r->cur);
+        r->cur += 4;
+        lua_createtable(L, 0, 0);
+        for (uint32_t i = 0; i < npairs; i++) {
+            if (decode_value(L, r, depth + 1) != 0) {
+                return -1;
+            } else if (lua_type(L, -1) == LUA_TNUMBER &&
+                       lua_tonumber(L, -1) != lua_tonumber(L, -1)) {
+                // NaN cannot be a key
+                return -1;
+            } else if (decode_value(L, r, depth + 1) != 0) {
+                return -1;
+            }
+            lua_rawset(L, -3);
+        }
+        return 0;
+    }
+
+    default:
+        return -1;
+    }
+}
+
+static int decode_lua(lua_State *L)
+{
+    size_t len      = 0;
+    const char *str = luaL_checklstring(L, 1, &len);
+    lua_Integer pos = luaL_optinteger(L, 2, 1);
+    reader_t r      = {0};
+    uint32_t reclen = 0;
+
+    luaL_argcheck(L, pos >= 1, 2, "positive integer expected");
+    lua_settop(L, 2);
+    if (len < (size_t)pos - 1 + RECORD_HDRLEN) {
+        // incomplete record
+        lua_pushnil(L);
+        return 1;
+    }
+    r.cur  = (const unsigned char *)str + pos - 1;
+    reclen = get_u32(r.cur);
+    r.cur += RECORD_HDRLEN;
+    if ((size_t)((const unsigned char *)str + len - r.cur) < reclen) {
+        // incomplete record
+        lua_pushnil(L);
+        return 1;
+    }
+    r.end = r.cur + reclen;
+
+    if (decode_value(L, &r, 1) != 0 || r.cur != r.end ||
+        lua_type(L, -1) != LUA_TTABLE) {
+        lua_settop(L, 2);
+        lua_pushnil(L);
+        lua_pushliteral(L, "malformed record");
+        return 2;
+    }
+    lua_pushinteger(L, pos + RECORD_HDRLEN + reclen);
+
+    return 2;
+}
+
+LUALIB_API int luaopen_testcase_record(lua_State *L)
+{
+    struct luaL_Reg funcs[] = {
+        {"encode", encode_lua},
+        {"decode", decode_lua},
+        {NULL,     NULL      }
+    };
+
+    lua_newtable(L);
+    for (struct luaL_Reg *ptr = funcs; ptr->name; ptr++) {
+        lua_pushcfunction(L, ptr->func);
+        lua_setfield(L, -2, ptr->name);
+    }
+    return 1;
+}
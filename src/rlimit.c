@@ -0,0 +1,318 @@
+/**
+ * Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+// lua
+#include <lauxlib.h>
+#include <lualib.h>
+
+/**
+ * memory limit
+ *
+ * the allocator of the lua state is replaced with the wrapper function that
+ * counts the bytes allocated since the limit is set, and fails the
+ * allocation that exceeds the limit. once the limit is exceeded, the extra
+ * MEMLIMIT_SLACK bytes are allowed to handle the error.
+ */
+#define MEMLIMIT_SLACK (1024 * 1024)
+
+typedef struct {
+    lua_Alloc allocf;
+    void *ud;
+    // bytes allocated since the limit is set. it is clamped to 0 so that
+    // releasing the memory allocated before does not raise the limit.
+    int64_t used;
+    // 0 means unlimited
+    int64_t limit;
+    int exceeded;
+} memlimit_t;
+
+static memlimit_t MEMLIMIT = {0};
+
+static void *limit_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    memlimit_t *m = (memlimit_t *)ud;
+    // osize is the type of object if ptr is NULL in lua 5.2 or later
+    int64_t cur   = ptr ? (int64_t)osize : 0;
+    void *p       = NULL;
+
+    if (m->limit && (int64_t)nsize > cur) {
+        int64_t limit = m->limit + (m->exceeded ? MEMLIMIT_SLACK : 0);
+        if (m->used + (int64_t)nsize - cur > limit) {
+            m->exceeded = 1;
+            return NULL;
+        }
+    }
+
+    p = m->allocf(m->ud, ptr, osize, nsize);
+    if (nsize == 0 || p) {
+        m->used += (int64_t)nsize - cur;
+        if (m->used < 0) {
+            m->used = 0;
+        }
+    }
+    return p;
+}
+
+static int memory_lua(lua_State *L)
+{
+    lua_Number bytes = luaL_optnumber(L, 1, 0);
+    void *ud         = NULL;
+
+    luaL_argcheck(L, bytes >= 0, 1, "unsigned number expected");
+    if (lua_getallocf(L, &ud) != limit_alloc) {
+        MEMLIMIT.allocf = lua_getallocf(L, &MEMLIMIT.ud);
+        lua_setallocf(L, limit_alloc, &MEMLIMIT);
+        if (lua_getallocf(L, &ud) != limit_alloc) {
+            lua_pushnil(L);
+            lua_pushliteral(L, "memory limit is not supported");
+            return 2;
+        }
+    }
+    MEMLIMIT.used     = 0;
+    MEMLIMIT.limit    = (int64_t)bytes;
+    MEMLIMIT.exceeded = 0;
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+/**
+ * CPU time limit
+ *
+ * the ITIMER_PROF timer sends SIGPROF when the process consumes the CPU time,
+ * and the signal handler sets the hook function that raises an error in the
+ * running lua function.
+ */
+static lua_State *CPU_L                   = NULL;
+static volatile sig_atomic_t CPU_EXCEEDED = 0;
+static lua_Hook CPU_PREV_HOOK             = NULL;
+static int CPU_PREV_MASK                  = 0;
+static int CPU_PREV_COUNT                 = 0;
+static struct sigaction CPU_PREV_ACT;
+static int CPU_ARMED                      = 0;
+
+static void cpu_hook(lua_State *L, lua_Debug *ar)
+{
+    (void)ar;
+    lua_sethook(L, CPU_PREV_HOOK, CPU_PREV_MASK, CPU_PREV_COUNT);
+    luaL_error(L, "CPU time limit exceeded");
+}
+
+static void on_sigprof(int signo)
+{
+    (void)signo;
+    if (CPU_L && !CPU_EXCEEDED) {
+        CPU_EXCEEDED = 1;
+        // lua_sethook can be called from the signal handler
+        lua_sethook(CPU_L, cpu_hook,
+                    LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+    }
+}
+
+static int cpu_lua(lua_State *L)
+{
+    lua_Number sec       = luaL_optnumber(L, 1, 0);
+    struct itimerval itv = {0};
+    struct sigaction act = {0};
+
+    luaL_argcheck(L, sec >= 0, 1, "unsigned number expected");
+    // disarm the timer and restore the hook
+    if (setitimer(ITIMER_PROF, &itv, NULL) == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    } else if (CPU_L && lua_gethook(CPU_L) == cpu_hook) {
+        lua_sethook(CPU_L, CPU_PREV_HOOK, CPU_PREV_MASK, CPU_PREV_COUNT);
+    }
+    CPU_L = NULL;
+    if (CPU_ARMED) {
+        // restore the signal handler installed before
+        CPU_ARMED = 0;
+        if (sigaction(SIGPROF, &CPU_PREV_ACT, NULL) == -1) {
+            lua_pushnil(L);
+            lua_pushstring(L, strerror(errno));
+            return 2;
+        }
+    }
+    if (sec == 0) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    act.sa_handler = on_sigprof;
+    sigemptyset(&act.sa_mask);
+    if (sigaction(SIGPROF, &act, &CPU_PREV_ACT) == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    CPU_ARMED = 1;
+
+    CPU_PREV_HOOK        = lua_gethook(L);
+    CPU_PREV_MASK        = lua_gethookmask(L);
+    CPU_PREV_COUNT       = lua_gethookcount(L);
+    CPU_EXCEEDED         = 0;
+    CPU_L                = L;
+    itv.it_value.tv_sec  = (time_t)sec;
+    itv.it_value.tv_usec = (suseconds_t)((sec - floor(sec)) * 1000000);
+    if (itv.it_value.tv_sec == 0 && itv.it_value.tv_usec == 0) {
+        itv.it_value.tv_usec = 1;
+    }
+    if (setitimer(ITIMER_PROF, &itv, NULL) == -1) {
+        int err   = errno;
+        CPU_L     = NULL;
+        CPU_ARMED = 0;
+        sigaction(SIGPROF, &CPU_PREV_ACT, NULL);
+        errno = err;
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int exceeded_lua(lua_State *L)
+{
+    if (CPU_EXCEEDED) {
+        CPU_EXCEEDED = 0;
+        lua_pushliteral(L, "cpu");
+        return 1;
+    } else if (MEMLIMIT.exceeded) {
+        MEMLIMIT.exceeded = 0;
+        lua_pushliteral(L, "memory");
+        return 1;
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+/**
+ * resource limits by setrlimit
+ */
+static const char *const RESOURCE_NAMES[] = {
+    "nofile", "nproc", "as", "cpu", NULL,
+};
+static const int RESOURCES[] = {
+    RLIMIT_NOFILE,
+    RLIMIT_NPROC,
+    RLIMIT_AS,
+    RLIMIT_CPU,
+};
+
+// errno of the system call that fails when the limit is reached
+static const int RESOURCE_ERRNOS[] = {
+    EMFILE,
+    EAGAIN,
+    ENOMEM,
+    0,
+};
+
+static void pushrlim(lua_State *L, rlim_t v)
+{
+    if (v == RLIM_INFINITY) {
+        lua_pushnumber(L, HUGE_VAL);
+    } else {
+        lua_pushnumber(L, (lua_Number)v);
+    }
+}
+
+static int get_lua(lua_State *L)
+{
+    int resource       = RESOURCES[luaL_checkoption(L, 1, NULL,
+                                                    RESOURCE_NAMES)];
+    struct rlimit rlim = {0};
+
+    if (getrlimit(resource, &rlim) == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    pushrlim(L, rlim.rlim_cur);
+    pushrlim(L, rlim.rlim_max);
+    return 2;
+}
+
+static int set_lua(lua_State *L)
+{
+    int resource       = RESOURCES[luaL_checkoption(L, 1, NULL,
+                                                    RESOURCE_NAMES)];
+    lua_Number v       = luaL_checknumber(L, 2);
+    struct rlimit rlim = {0};
+
+    luaL_argcheck(L, v >= 0, 2, "unsigned number expected");
+    if (getrlimit(resource, &rlim) == -1) {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    // only the soft limit is changed
+    rlim.rlim_cur = isinf(v) ? RLIM_INFINITY : (rlim_t)v;
+    if (setrlimit(resource, &rlim) == -1) {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int errmsg_lua(lua_State *L)
+{
+    int err = RESOURCE_ERRNOS[luaL_checkoption(L, 1, NULL, RESOURCE_NAMES)];
+
+    if (err) {
+        lua_pushstring(L, strerror(err));
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+LUALIB_API int luaopen_testcase_rlimit(lua_State *L)
+{
+    struct luaL_Reg funcs[] = {
+        {"get",      get_lua     },
+        {"set",      set_lua     },
+        {"memory",   memory_lua  },
+        {"cpu",      cpu_lua     },
+        {"exceeded", exceeded_lua},
+        {"errmsg",   errmsg_lua  },
+        {NULL,       NULL        }
+    };
+
+    lua_newtable(L);
+    for (struct luaL_Reg *ptr = funcs; ptr->name; ptr++) {
+        lua_pushcfunction(L, ptr->func);
+        lua_setfield(L, -2, ptr->name);
+    }
+    return 1;
+}
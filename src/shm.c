@@ -0,0 +1,253 @@
+/**
+ *  Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// lua
+#include <lua_errno.h>
+
+#define MODULE_MT "testcase.shm"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+typedef struct {
+    // read-only region shared with the forked child processes
+    const char *addr;
+    size_t len;
+    // size of the mapping
+    size_t maplen;
+} testcase_shm_t;
+
+static inline testcase_shm_t *checkshm(lua_State *L)
+{
+    testcase_shm_t *shm = luaL_checkudata(L, 1, MODULE_MT);
+    if (!shm->addr) {
+        luaL_argerror(L, 1, "attempt to use a closed shared memory");
+    }
+    return shm;
+}
+
+// memmem is not available on all platforms without the feature macros
+static const char *findmem(const char *s, size_t len, const char *pat,
+                           size_t plen)
+{
+    const char *end = s + len;
+
+    if (plen == 0) {
+        return s;
+    }
+    while ((size_t)(end - s) >= plen) {
+        s = memchr(s, *pat, end - s - plen + 1);
+        if (!s) {
+            return NULL;
+        } else if (memcmp(s, pat, plen) == 0) {
+            return s;
+        }
+        s++;
+    }
+    return NULL;
+}
+
+// converts the string.sub style position to the zero-based offset
+static inline size_t posrelat(lua_Integer pos, size_t len)
+{
+    if (pos >= 0) {
+        return (size_t)pos;
+    } else if ((size_t)-pos > len) {
+        return 0;
+    }
+    return len + (size_t)pos + 1;
+}
+
+static int find_lua(lua_State *L)
+{
+    testcase_shm_t *shm = checkshm(L);
+    size_t plen         = 0;
+    const char *pat     = luaL_checklstring(L, 2, &plen);
+    size_t init         = posrelat(luaL_optinteger(L, 3, 1), shm->len);
+    const char *found   = NULL;
+
+    if (init < 1) {
+        init = 1;
+    } else if (init > shm->len + 1) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // plain search without copying the region into the lua heap
+    found = findmem(shm->addr + init - 1, shm->len - init + 1, pat, plen);
+    if (!found) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, found - shm->addr + 1);
+    lua_pushinteger(L, found - shm->addr + plen);
+    return 2;
+}
+
+static int byte_lua(lua_State *L)
+{
+    testcase_shm_t *shm = checkshm(L);
+    size_t pos          = posrelat(luaL_optinteger(L, 2, 1), shm->len);
+
+    if (pos < 1 || pos > shm->len) {
+        return 0;
+    }
+    lua_pushinteger(L, (unsigned char)shm->addr[pos - 1]);
+    return 1;
+}
+
+static int sub_lua(lua_State *L)
+{
+    testcase_shm_t *shm = checkshm(L);
+    size_t head         = posrelat(luaL_optinteger(L, 2, 1), shm->len);
+    size_t tail         = posrelat(luaL_optinteger(L, 3, -1), shm->len);
+
+    if (head < 1) {
+        head = 1;
+    }
+    if (tail > shm->len) {
+        tail = shm->len;
+    }
+    if (head > tail) {
+        lua_pushliteral(L, "");
+    } else {
+        lua_pushlstring(L, shm->addr + head - 1, tail - head + 1);
+    }
+    return 1;
+}
+
+static int len_lua(lua_State *L)
+{
+    testcase_shm_t *shm = checkshm(L);
+
+    lua_pushinteger(L, shm->len);
+    return 1;
+}
+
+static int close_lua(lua_State *L)
+{
+    testcase_shm_t *shm = luaL_checkudata(L, 1, MODULE_MT);
+
+    if (shm->addr) {
+        munmap((void *)shm->addr, shm->maplen);
+        shm->addr = NULL;
+    }
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    lua_pushfstring(L, MODULE_MT ": %p", lua_touserdata(L, 1));
+    return 1;
+}
+
+static int gc_lua(lua_State *L)
+{
+    testcase_shm_t *shm = lua_touserdata(L, 1);
+
+    if (shm->addr) {
+        munmap((void *)shm->addr, shm->maplen);
+    }
+    return 0;
+}
+
+static int new_lua(lua_State *L)
+{
+    size_t len          = 0;
+    const char *data    = luaL_checklstring(L, 1, &len);
+    testcase_shm_t *shm = lua_newuserdata(L, sizeof(testcase_shm_t));
+    // mmap does not accept the zero length
+    size_t maplen       = len ? len : 1;
+    void *addr          = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    *shm = (testcase_shm_t){0};
+    if (addr == MAP_FAILED) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "mmap");
+        return 2;
+    }
+
+    memcpy(addr, data, len);
+    // the region is inherited by the forked child processes without copying,
+    // and any write to it raises SIGSEGV
+    if (mprotect(addr, maplen, PROT_READ) == -1) {
+        int err = errno;
+        munmap(addr, maplen);
+        lua_pushnil(L);
+        lua_errno_new(L, err, "mprotect");
+        return 2;
+    }
+
+    *shm = (testcase_shm_t){
+        .addr   = addr,
+        .len    = len,
+        .maplen = maplen,
+    };
+    luaL_getmetatable(L, MODULE_MT);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+LUALIB_API int luaopen_testcase_shm(lua_State *L)
+{
+    lua_errno_loadlib(L);
+
+    // create metatable
+    if (luaL_newmetatable(L, MODULE_MT)) {
+        struct luaL_Reg mmethod[] = {
+            {"__gc",       gc_lua      },
+            {"__len",      len_lua     },
+            {"__tostring", tostring_lua},
+            {NULL,         NULL        }
+        };
+        struct luaL_Reg method[] = {
+            {"len",   len_lua  },
+            {"sub",   sub_lua  },
+            {"byte",  byte_lua },
+            {"find",  find_lua },
+            {"close", close_lua},
+            {NULL,    NULL     }
+        };
+
+        // metamethods
+        for (struct luaL_Reg *ptr = mmethod; ptr->name; ptr++) {
+            lua_pushcfunction(L, ptr->func);
+            lua_setfield(L, -2, ptr->name);
+        }
+        // methods
+        lua_newtable(L);
+        for (struct luaL_Reg *ptr = method; ptr->name; ptr++) {
+            lua_pushcfunction(L, ptr->func);
+            lua_setfield(L, -2, ptr->name);
+        }
+        lua_setfield(L, -2, "__index");
+    }
+    lua_settop(L, 0);
+
+    lua_pushcfunction(L, new_lua);
+    return 1;
+}
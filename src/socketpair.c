@@ -22,57 +22,376 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
-// lualib
-#include <lauxlib.h>
-#include <lualib.h>
+#if defined(__linux__)
+# include <sys/sendfile.h>
+#endif
+// lua
+#include <lua_errno.h>
 
 #define MODULE_MT "testcase.socketpair"
 
-static int write_lua(lua_State *L)
+#define DEFAULT_READSIZE 4096
+
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif
+
+// maximum number of the descriptors received by recvfd at once. the extra
+// descriptors are closed.
+#define RECVFD_MAX 16
+
+typedef struct {
+    int fd;
+    // reusable read buffer
+    char *buf;
+    size_t cap;
+    // the byte consumed by recvfd without a descriptor, or -1
+    int unread;
+} testcase_socket_t;
+
+static inline int pusherror(lua_State *L)
 {
-    int *sock       = luaL_checkudata(L, 1, MODULE_MT);
-    size_t len      = 0;
-    const char *msg = luaL_checklstring(L, 2, &len);
-    ssize_t n       = write(*sock, msg, len);
+    lua_pushnil(L);
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        lua_pushnil(L);
+        lua_pushboolean(L, 1);
+        return 3;
+    }
+    lua_pushstring(L, strerror(errno));
+    return 2;
+}
 
+static inline char *growbuf(testcase_socket_t *s, size_t size)
+{
+    if (s->cap < size) {
+        char *buf = realloc(s->buf, size);
+        if (!buf) {
+            return NULL;
+        }
+        s->buf = buf;
+        s->cap = size;
+    }
+    return s->buf;
+}
+
+static inline int checkfd(lua_State *L, int idx)
+{
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+        return luaL_checkinteger(L, idx);
+    } else {
+        FILE **fp = lauxh_checkfilep(L, idx);
+#if LUA_VERSION_NUM >= 502
+        // the closed file keeps the FILE pointer but has no close function
+        if (((luaL_Stream *)fp)->closef == NULL) {
+#else
+        if (!*fp) {
+#endif
+            return luaL_argerror(L, idx, "attempt to use a closed file");
+        }
+        return fileno(*fp);
+    }
+}
+
+static int recvfd_lua(lua_State *L)
+{
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    unsigned char data   = 0;
+    struct iovec iov     = {.iov_base = &data, .iov_len = 1};
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * RECVFD_MAX)];
+    } cmsgbuf         = {0};
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cmsgbuf.buf,
+        .msg_controllen = sizeof(cmsgbuf.buf),
+    };
+    int fd    = -1;
+    ssize_t n = 0;
+
+    if (s->unread != -1) {
+        // the pending byte does not carry any descriptor
+        lua_pushnil(L);
+        lua_pushstring(L, "no file descriptor received");
+        return 2;
+    }
+
+    n = recvmsg(s->fd, &msg, 0);
     if (n == -1) {
+        return pusherror(L);
+    } else if (n == 0) {
         lua_pushnil(L);
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            lua_pushnil(L);
-            lua_pushboolean(L, 1);
-            return 3;
+        return 1;
+    }
+
+    // take the first descriptor and close the others
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int *fds = (int *)CMSG_DATA(cmsg);
+            size_t nfd =
+                (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+            for (size_t i = 0; i < nfd; i++) {
+                if (fd == -1) {
+                    fd = fds[i];
+                } else {
+                    close(fds[i]);
+                }
+            }
         }
-        lua_pushstring(L, strerror(errno));
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC) {
+        // some descriptors were discarded by the kernel
+        if (fd != -1) {
+            close(fd);
+        }
+        lua_pushnil(L);
+        lua_pushstring(L, "control message truncated");
+        return 2;
+    } else if (fd == -1) {
+        // keep the stream data for the next read
+        s->unread = data;
+        lua_pushnil(L);
+        lua_pushstring(L, "no file descriptor received");
         return 2;
     }
+    lua_pushinteger(L, fd);
+    return 1;
+}
+
+static int sendfd_lua(lua_State *L)
+{
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    int fd               = checkfd(L, 2);
+    char data            = 0;
+    struct iovec iov     = {.iov_base = &data, .iov_len = 1};
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } cmsgbuf         = {0};
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cmsgbuf.buf,
+        .msg_controllen = sizeof(cmsgbuf.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level        = SOL_SOCKET;
+    cmsg->cmsg_type         = SCM_RIGHTS;
+    cmsg->cmsg_len          = CMSG_LEN(sizeof(int));
+    *(int *)CMSG_DATA(cmsg) = fd;
+    if (sendmsg(s->fd, &msg, 0) == -1) {
+        return pusherror(L);
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int sendfile_lua(lua_State *L)
+{
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    int fd               = checkfd(L, 2);
+    off_t offset         = (off_t)luaL_optinteger(L, 3, 0);
+    size_t count         = 0;
+    ssize_t n            = 0;
+
+    if (lua_isnoneornil(L, 4)) {
+        struct stat st = {0};
+        if (fstat(fd, &st) == -1) {
+            lua_pushnil(L);
+            lua_pushstring(L, strerror(errno));
+            return 2;
+        } else if (st.st_size <= offset) {
+            lua_pushinteger(L, 0);
+            return 1;
+        }
+        count = st.st_size - offset;
+    } else {
+        lua_Integer len = luaL_checkinteger(L, 4);
+        luaL_argcheck(L, len >= 0, 4, "count must not be negative");
+        count = (size_t)len;
+    }
+
+#if defined(__linux__)
+    n = sendfile(s->fd, fd, &offset, count);
+#elif defined(__APPLE__)
+    {
+        off_t len = count;
+        if (sendfile(fd, s->fd, offset, &len, NULL, 0) == -1 && len == 0) {
+            return pusherror(L);
+        }
+        n = len;
+    }
+#else
+    {
+        // fallback to pread and write
+        char *buf = growbuf(s, DEFAULT_READSIZE);
+        if (!buf) {
+            lua_pushnil(L);
+            lua_pushstring(L, strerror(errno));
+            return 2;
+        }
+        n = pread(fd, buf, count < s->cap ? count : s->cap, offset);
+        if (n > 0) {
+            n = write(s->fd, buf, n);
+        }
+    }
+#endif
 
+    if (n == -1) {
+        return pusherror(L);
+    }
     lua_pushinteger(L, n);
     return 1;
 }
 
-static int read_lua(lua_State *L)
+static int writev_lua(lua_State *L)
 {
-    int *sock      = luaL_checkudata(L, 1, MODULE_MT);
-    char buf[4096] = {0};
-    ssize_t n      = read(*sock, buf, sizeof(buf));
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    struct iovec iov[64] = {0};
+    struct iovec *iovp   = iov;
+    int iovcnt           = 0;
+    ssize_t n            = 0;
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 2);
+    iovcnt = lauxh_rawlen(L, 2);
+    if (iovcnt > IOV_MAX) {
+        return luaL_argerror(L, 2, lua_pushfstring(L, "too many buffers "
+                                                      "(limit is %d)",
+                                                   IOV_MAX));
+    }
+    if (iovcnt > (int)(sizeof(iov) / sizeof(struct iovec))) {
+        iovp = lua_newuserdata(L, sizeof(struct iovec) * iovcnt);
+    }
 
+    // the table at index 2 holds the strings while writing
+    for (int i = 0; i < iovcnt; i++) {
+        size_t len = 0;
+        lua_rawgeti(L, 2, i + 1);
+        if (lua_type(L, -1) != LUA_TSTRING) {
+            return luaL_error(L, "invalid value #%d in table (string "
+                                 "expected, got %s)",
+                              i + 1, luaL_typename(L, -1));
+        }
+        iovp[i].iov_base = (void *)lua_tolstring(L, -1, &len);
+        iovp[i].iov_len  = len;
+        lua_pop(L, 1);
+    }
+
+    n = writev(s->fd, iovp, iovcnt);
     if (n == -1) {
-        lua_pushnil(L);
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return pusherror(L);
+    }
+    lua_pushinteger(L, n);
+    return 1;
+}
+
+static int write_lua(lua_State *L)
+{
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    size_t len           = 0;
+    const char *msg      = luaL_checklstring(L, 2, &len);
+    ssize_t n            = write(s->fd, msg, len);
+
+    if (n == -1) {
+        return pusherror(L);
+    }
+
+    lua_pushinteger(L, n);
+    return 1;
+}
+
+// put the byte consumed by recvfd to the head of the buffer
+static inline size_t takeunread(testcase_socket_t *s)
+{
+    if (s->unread == -1 || !growbuf(s, s->cap ? s->cap : DEFAULT_READSIZE)) {
+        return 0;
+    }
+    s->buf[0] = (char)s->unread;
+    s->unread = -1;
+    return 1;
+}
+
+static int readall_lua(lua_State *L)
+{
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    size_t len           = takeunread(s);
+
+    // read until EOF or EAGAIN
+    while (1) {
+        ssize_t n = 0;
+
+        if (len == s->cap &&
+            !growbuf(s, s->cap ? s->cap * 2 : DEFAULT_READSIZE)) {
+            if (len) {
+                // return the data already read
+                break;
+            }
             lua_pushnil(L);
-            lua_pushboolean(L, 1);
-            return 3;
+            lua_pushstring(L, strerror(errno));
+            return 2;
         }
+
+        n = read(s->fd, s->buf + len, s->cap - len);
+        if (n > 0) {
+            len += n;
+        } else if (n == 0) {
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (len && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return pusherror(L);
+        }
+    }
+
+    if (len == 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushlstring(L, s->buf, len);
+    }
+    return 1;
+}
+
+static int read_lua(lua_State *L)
+{
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    lua_Integer size     = luaL_optinteger(L, 2, DEFAULT_READSIZE);
+    ssize_t n            = 0;
+
+    luaL_argcheck(L, size > 0, 2, "size must be greater than 0");
+    if (!growbuf(s, size)) {
+        lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
         return 2;
+    } else if (takeunread(s)) {
+        // returns the pending byte without blocking
+        lua_pushlstring(L, s->buf, 1);
+        return 1;
+    }
+
+    n = read(s->fd, s->buf, size);
+    if (n == -1) {
+        return pusherror(L);
     } else if (n == 0) {
         lua_pushnil(L);
     } else {
-        lua_pushlstring(L, buf, n);
+        lua_pushlstring(L, s->buf, n);
     }
 
     return 1;
@@ -80,9 +399,9 @@ static int read_lua(lua_State *L)
 
 static inline int do_shutdown(lua_State *L, int how)
 {
-    int *sock = luaL_checkudata(L, 1, MODULE_MT);
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
 
-    if (shutdown(*sock, how) == 0) {
+    if (shutdown(s->fd, how) == 0) {
         lua_pushboolean(L, 1);
         return 1;
     }
@@ -108,22 +427,22 @@ static int shutdown_lua(lua_State *L)
 
 static int close_lua(lua_State *L)
 {
-    int *sock = luaL_checkudata(L, 1, MODULE_MT);
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
 
-    if (*sock != -1) {
-        close(*sock);
-        *sock = -1;
+    if (s->fd != -1) {
+        close(s->fd);
+        s->fd = -1;
     }
     return 0;
 }
 
 static inline int sockbuf(lua_State *L, int sockopt)
 {
-    int *sock         = luaL_checkudata(L, 1, MODULE_MT);
-    int should_change = lua_gettop(L) > 1;
-    socklen_t len     = sizeof(int);
-    int bufsize       = 0;
-    int newsize       = -1;
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    int should_change    = lua_gettop(L) > 1;
+    socklen_t len        = sizeof(int);
+    int bufsize          = 0;
+    int newsize          = -1;
 
     if (should_change) {
         lua_settop(L, 2);
@@ -131,7 +450,7 @@ static inline int sockbuf(lua_State *L, int sockopt)
     }
 
     // get current buffer size
-    if (getsockopt(*sock, SOL_SOCKET, sockopt, (void *)&bufsize, &len) == -1) {
+    if (getsockopt(s->fd, SOL_SOCKET, sockopt, (void *)&bufsize, &len) == -1) {
         lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
         return 2;
@@ -140,7 +459,7 @@ static inline int sockbuf(lua_State *L, int sockopt)
 
     // change buffer size
     if (should_change) {
-        if (setsockopt(*sock, SOL_SOCKET, sockopt, (void *)&newsize,
+        if (setsockopt(s->fd, SOL_SOCKET, sockopt, (void *)&newsize,
                        sizeof(int)) == -1) {
             lua_pushnil(L);
             lua_pushstring(L, strerror(errno));
@@ -163,9 +482,9 @@ static int recvbuf_lua(lua_State *L)
 
 static int nonblock_lua(lua_State *L)
 {
-    int *sock         = luaL_checkudata(L, 1, MODULE_MT);
-    int should_change = lua_gettop(L) > 1;
-    int enabled       = 0;
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
+    int should_change    = lua_gettop(L) > 1;
+    int enabled          = 0;
 
     if (should_change) {
         luaL_checktype(L, 2, LUA_TBOOLEAN);
@@ -173,7 +492,7 @@ static int nonblock_lua(lua_State *L)
     }
 
     // get O_NONBLOCK flag from socket
-    int flags = fcntl(*sock, F_GETFL, 0);
+    int flags = fcntl(s->fd, F_GETFL, 0);
     if (flags == -1) {
         lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
@@ -195,7 +514,7 @@ static int nonblock_lua(lua_State *L)
             flags &= ~O_NONBLOCK;
         }
 
-        if (fcntl(*sock, F_SETFL, flags) == -1) {
+        if (fcntl(s->fd, F_SETFL, flags) == -1) {
             lua_pushnil(L);
             lua_pushstring(L, strerror(errno));
             return 2;
@@ -207,9 +526,9 @@ static int nonblock_lua(lua_State *L)
 
 static int fd_lua(lua_State *L)
 {
-    int *sock = luaL_checkudata(L, 1, MODULE_MT);
+    testcase_socket_t *s = luaL_checkudata(L, 1, MODULE_MT);
 
-    lua_pushinteger(L, *sock);
+    lua_pushinteger(L, s->fd);
     return 1;
 }
 
@@ -221,11 +540,12 @@ static int tostring_lua(lua_State *L)
 
 static int gc_lua(lua_State *L)
 {
-    int *sock = lua_touserdata(L, 1);
+    testcase_socket_t *s = lua_touserdata(L, 1);
 
-    if (*sock != -1) {
-        close(*sock);
+    if (s->fd != -1) {
+        close(s->fd);
     }
+    free(s->buf);
     return 0;
 }
 
@@ -239,9 +559,9 @@ static int new_lua(lua_State *L)
         nonblock = lua_toboolean(L, 1);
     }
 
-    int *sock1  = lua_newuserdata(L, sizeof(int));
-    int *sock2  = lua_newuserdata(L, sizeof(int));
-    int pair[2] = {0};
+    testcase_socket_t *sock1 = lua_newuserdata(L, sizeof(testcase_socket_t));
+    testcase_socket_t *sock2 = lua_newuserdata(L, sizeof(testcase_socket_t));
+    int pair[2]              = {0};
     if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
         lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
@@ -253,11 +573,13 @@ static int new_lua(lua_State *L)
         fcntl(pair[1], F_SETFL, O_NONBLOCK);
     }
 
-    *sock2 = pair[1];
+    *sock2 = (testcase_socket_t){
+        .fd = pair[1], .buf = NULL, .cap = 0, .unread = -1};
     luaL_getmetatable(L, MODULE_MT);
     lua_setmetatable(L, -2);
 
-    *sock1 = pair[0];
+    *sock1 = (testcase_socket_t){
+        .fd = pair[0], .buf = NULL, .cap = 0, .unread = -1};
     lua_pushvalue(L, -2);
     luaL_getmetatable(L, MODULE_MT);
     lua_setmetatable(L, -2);
@@ -284,7 +606,12 @@ LUALIB_API int luaopen_testcase_socketpair(lua_State *L)
             {"shutrd",   shutrd_lua  },
             {"shutwr",   shutwr_lua  },
             {"read",     read_lua    },
+            {"readall",  readall_lua },
             {"write",    write_lua   },
+            {"writev",   writev_lua  },
+            {"sendfile", sendfile_lua},
+            {"sendfd",   sendfd_lua  },
+            {"recvfd",   recvfd_lua  },
             {NULL,       NULL        }
         };
 
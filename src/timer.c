@@ -27,6 +27,11 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+# include <x86intrin.h>
+# define TESTCASE_HAVE_TSC 1
+#endif
 
 #if defined(__APPLE__)
 # include <mach/mach.h>
@@ -68,13 +73,98 @@ static inline int getnsec(uint64_t *ns)
     return 0;
 }
 
+// nanoseconds per TSC tick. 0 if the invariant TSC is not available, and -1
+// if it is not calibrated yet.
+static double TSC_NSEC = -1;
+// TSC tick and monotonic clock at the calibration. the ticks elapsed from
+// TSC_BASE are scaled so that the double keeps the precision. the base is
+// moved forward continuously on the recalibration, so the clock of the
+// running timers never goes backward.
+static uint64_t TSC_BASE  = 0;
+static uint64_t NSEC_BASE = 0;
+
+#ifdef TESTCASE_HAVE_TSC
+
+static double calibrate_tsc(void)
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    uint64_t ns0     = 0, ns1 = 0, c0 = 0, c1 = 0;
+
+    // the TSC must be invariant to be used as a clock source
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+        !(edx & (1 << 8)) || getnsec(&ns0) == -1) {
+        return 0;
+    }
+    // count the ticks for 10ms
+    c0 = __rdtsc();
+    do {
+        if (getnsec(&ns1) == -1) {
+            return 0;
+        }
+    } while (ns1 - ns0 < 10000000);
+    c1 = __rdtsc();
+    if (c1 <= c0) {
+        return 0;
+    }
+
+    if (TSC_NSEC > 0) {
+        // rebase at c1 on the previous scale
+        NSEC_BASE += (uint64_t)((double)(c1 - TSC_BASE) * TSC_NSEC);
+    } else {
+        NSEC_BASE = ns1;
+    }
+    TSC_BASE = c1;
+    return (double)(ns1 - ns0) / (double)(c1 - c0);
+}
+
+#else
+
+static double calibrate_tsc(void)
+{
+    return 0;
+}
+
+#endif
+
 #define TESTCASE_TIMER_MT "testcase.timer"
 
 typedef struct {
     uint64_t total;
     uint64_t start;
+    int tsc;
 } testcase_timer_t;
 
+// overhead of the successive lap calls in nanoseconds for each clock source.
+// UINT64_MAX if it is not calibrated yet.
+static uint64_t OVERHEAD[2] = {UINT64_MAX, UINT64_MAX};
+
+static inline int timer_now(testcase_timer_t *t, uint64_t *ns)
+{
+#ifdef TESTCASE_HAVE_TSC
+    if (t->tsc) {
+        *ns = NSEC_BASE + (uint64_t)((double)(__rdtsc() - TSC_BASE) *
+                                     TSC_NSEC);
+        return 0;
+    }
+#endif
+    return getnsec(ns);
+}
+
+static inline uint64_t timer_lap(testcase_timer_t *t, uint64_t ns)
+{
+    uint64_t elapsed = ns - t->start;
+
+    // subtract the overhead of the timer itself
+    if (elapsed > OVERHEAD[t->tsc]) {
+        elapsed -= OVERHEAD[t->tsc];
+    } else {
+        elapsed = 0;
+    }
+    t->total += elapsed;
+    t->start = ns;
+    return elapsed;
+}
+
 static int nsec2utime(lua_State *L, uint64_t ns)
 {
     static const long double us  = 1000;
@@ -117,7 +207,7 @@ static int elapsed_lua(lua_State *L)
         (testcase_timer_t *)luaL_checkudata(L, 1, TESTCASE_TIMER_MT);
     uint64_t ns = 0;
 
-    if (getnsec(&ns) == -1) {
+    if (timer_now(t, &ns) == -1) {
         lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
         return 2;
@@ -130,20 +220,15 @@ static int stop_lua(lua_State *L)
 {
     testcase_timer_t *t =
         (testcase_timer_t *)luaL_checkudata(L, 1, TESTCASE_TIMER_MT);
-    uint64_t ns      = 0;
-    uint64_t elapsed = 0;
+    uint64_t ns = 0;
 
-    if (getnsec(&ns) == -1) {
+    if (timer_now(t, &ns) == -1) {
         lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
         return 2;
     }
 
-    elapsed = ns - t->start;
-    t->total += elapsed;
-    t->start = ns;
-
-    return nsec2utime(L, elapsed);
+    return nsec2utime(L, timer_lap(t, ns));
 }
 
 static int start_lua(lua_State *L)
@@ -152,7 +237,7 @@ static int start_lua(lua_State *L)
         (testcase_timer_t *)luaL_checkudata(L, 1, TESTCASE_TIMER_MT);
     uint64_t ns = 0;
 
-    if (getnsec(&ns) == -1) {
+    if (timer_now(t, &ns) == -1) {
         lua_pushboolean(L, 0);
         lua_pushstring(L, strerror(errno));
         return 2;
@@ -163,6 +248,23 @@ static int start_lua(lua_State *L)
     return 1;
 }
 
+static int lap_lua(lua_State *L)
+{
+    testcase_timer_t *t =
+        (testcase_timer_t *)luaL_checkudata(L, 1, TESTCASE_TIMER_MT);
+    uint64_t ns = 0;
+
+    if (timer_now(t, &ns) == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+
+    lua_pushinteger(L, (lua_Integer)timer_lap(t, ns));
+
+    return 1;
+}
+
 static int total_lua(lua_State *L)
 {
     testcase_timer_t *t =
@@ -170,6 +272,14 @@ static int total_lua(lua_State *L)
     return nsec2utime(L, t->total);
 }
 
+static int nsec_lua(lua_State *L)
+{
+    testcase_timer_t *t =
+        (testcase_timer_t *)luaL_checkudata(L, 1, TESTCASE_TIMER_MT);
+    lua_pushinteger(L, (lua_Integer)t->total);
+    return 1;
+}
+
 static int reset_lua(lua_State *L)
 {
     testcase_timer_t *t =
@@ -184,19 +294,171 @@ static int tostring_lua(lua_State *L)
     return 1;
 }
 
-static int new_lua(lua_State *L)
+static testcase_timer_t *newtimer(lua_State *L, int tsc)
 {
     testcase_timer_t *t =
         (testcase_timer_t *)lua_newuserdata(L, sizeof(testcase_timer_t));
-    *t = (testcase_timer_t){.total = 0, .start = 0};
+    *t = (testcase_timer_t){.total = 0, .start = 0, .tsc = tsc};
     luaL_getmetatable(L, TESTCASE_TIMER_MT);
     lua_setmetatable(L, -2);
+    return t;
+}
+
+#define CALIBRATE_NITER 1000
+
+/**
+ * calibrate_overhead measures the minimum interval of the successive lap
+ * calls through the lua_call, and uses it as the overhead of the timer.
+ */
+static uint64_t calibrate_overhead(lua_State *L, int tsc)
+{
+    int top             = lua_gettop(L);
+    uint64_t min        = UINT64_MAX;
+    testcase_timer_t *t = NULL;
+
+    OVERHEAD[tsc] = 0;
+    lua_pushcfunction(L, lap_lua);
+    t = newtimer(L, tsc);
+    if (timer_now(t, &t->start) == -1) {
+        lua_settop(L, top);
+        return 0;
+    }
+    for (int i = 0; i < CALIBRATE_NITER; i++) {
+        uint64_t ns = 0;
+
+        lua_pushvalue(L, top + 1);
+        lua_pushvalue(L, top + 2);
+        lua_call(L, 1, 1);
+        ns = (uint64_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        if (ns < min) {
+            min = ns;
+        }
+    }
+    lua_settop(L, top);
+    OVERHEAD[tsc] = min;
+
+    return min;
+}
+
+static int use_tsc(void)
+{
+    if (TSC_NSEC < 0) {
+        TSC_NSEC = calibrate_tsc();
+        // the overhead is measured again with the new scale
+        OVERHEAD[1] = UINT64_MAX;
+    }
+    return TSC_NSEC > 0;
+}
+
+static int new_lua(lua_State *L)
+{
+    int tsc = lua_toboolean(L, 1);
+
+    lua_settop(L, 0);
+    tsc = tsc && use_tsc();
+    // the overhead is calibrated when the clock source is used first
+    if (OVERHEAD[tsc] == UINT64_MAX) {
+        calibrate_overhead(L, tsc);
+    }
+    newtimer(L, tsc);
+    return 1;
+}
+
+static int calibrate_lua(lua_State *L)
+{
+    double scale = 0;
+
+    lua_settop(L, 0);
+    lua_pushinteger(L, (lua_Integer)calibrate_overhead(L, 0));
+    // recalibrate the TSC. the previous scale is kept on failure so that the
+    // running timers keep working.
+    scale = calibrate_tsc();
+    if (scale > 0 || TSC_NSEC < 0) {
+        TSC_NSEC = scale;
+    }
+    if (TSC_NSEC > 0) {
+        lua_pushinteger(L, (lua_Integer)calibrate_overhead(L, 1));
+        lua_pushnumber(L, TSC_NSEC);
+        return 3;
+    }
+    return 1;
+}
+
+static int clock_lua(lua_State *L)
+{
+    uint64_t ns = 0;
+
+    if (getnsec(&ns) == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    lua_pushinteger(L, (lua_Integer)ns);
+
+    return 1;
+}
+
+static int format_lua(lua_State *L)
+{
+    lua_Number ns = luaL_checknumber(L, 1);
+
+    luaL_argcheck(L, ns >= 0, 1, "unsigned number expected");
+    return nsec2utime(L, (uint64_t)ns);
+}
+
+/**
+ * virtual clock
+ *
+ * while the virtual clock is enabled, the sleep and usleep functions do not
+ * sleep but advance the virtual clock, and the nanotime function returns the
+ * virtual clock. the timer objects always use the real clock.
+ */
+static int VCLOCK_ENABLED = 0;
+static uint64_t VCLOCK    = 0;
+
+static int virtual_lua(lua_State *L)
+{
+    int prev = VCLOCK_ENABLED;
+
+    if (!lua_isnoneornil(L, 1)) {
+        luaL_checktype(L, 1, LUA_TBOOLEAN);
+        if (lua_toboolean(L, 1) && !VCLOCK_ENABLED) {
+            // start the virtual clock from the current real clock
+            if (getnsec(&VCLOCK) == -1) {
+                lua_pushnil(L);
+                lua_pushstring(L, strerror(errno));
+                return 2;
+            }
+        }
+        VCLOCK_ENABLED = lua_toboolean(L, 1);
+    }
+    lua_pushboolean(L, prev);
+
     return 1;
 }
 
+static int advance_lua(lua_State *L)
+{
+    lua_Number sec = luaL_checknumber(L, 1);
+
+    luaL_argcheck(L, sec >= 0, 1, "unsigned number expected");
+    if (!VCLOCK_ENABLED) {
+        return luaL_error(L, "virtual clock is not enabled");
+    }
+    VCLOCK += (uint64_t)(sec * 1000000000);
+
+    return 0;
+}
+
 static int usleep_lua(lua_State *L)
 {
     useconds_t usec = luaL_checkinteger(L, 1);
+
+    if (VCLOCK_ENABLED) {
+        VCLOCK += (uint64_t)usec * 1000;
+        return 0;
+    }
     usleep(usec);
     return 0;
 }
@@ -209,6 +471,12 @@ static int sleep_lua(lua_State *L)
     };
     ts.tv_nsec = (sec - ts.tv_sec) * 1000000000;
 
+    if (VCLOCK_ENABLED) {
+        if (sec > 0) {
+            VCLOCK += (uint64_t)(sec * 1000000000);
+        }
+        return 0;
+    }
     nanosleep(&ts, NULL);
 
     return 0;
@@ -218,7 +486,11 @@ static int nanotime_lua(lua_State *L)
 {
     struct timespec ts = {0};
 
-    if (getnsec_ex(&ts) == -1) {
+    if (VCLOCK_ENABLED) {
+        lua_pushnumber(L, (double)(VCLOCK / 1000000000) +
+                              ((double)(VCLOCK % 1000000000) / 1000000000));
+        return 1;
+    } else if (getnsec_ex(&ts) == -1) {
         lua_pushnil(L);
         lua_pushstring(L, strerror(errno));
         return 2;
@@ -239,9 +511,11 @@ LUALIB_API int luaopen_testcase_timer(lua_State *L)
         struct luaL_Reg method[] = {
             {"reset",   reset_lua  },
             {"total",   total_lua  },
+            {"nsec",    nsec_lua   },
             {"start",   start_lua  },
             {"stop",    stop_lua   },
             {"elapsed", elapsed_lua},
+            {"lap",     lap_lua    },
             {NULL,      NULL       }
         };
         struct luaL_Reg *ptr = mmethod;
@@ -282,6 +556,21 @@ LUALIB_API int luaopen_testcase_timer(lua_State *L)
     lua_pushstring(L, "nanotime");
     lua_pushcfunction(L, nanotime_lua);
     lua_rawset(L, -3);
+    lua_pushstring(L, "virtual");
+    lua_pushcfunction(L, virtual_lua);
+    lua_rawset(L, -3);
+    lua_pushstring(L, "advance");
+    lua_pushcfunction(L, advance_lua);
+    lua_rawset(L, -3);
+    lua_pushstring(L, "clock");
+    lua_pushcfunction(L, clock_lua);
+    lua_rawset(L, -3);
+    lua_pushstring(L, "format");
+    lua_pushcfunction(L, format_lua);
+    lua_rawset(L, -3);
+    lua_pushstring(L, "calibrate");
+    lua_pushcfunction(L, calibrate_lua);
+    lua_rawset(L, -3);
 
     return 1;
 }
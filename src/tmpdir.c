@@ -0,0 +1,146 @@
+/**
+ *  Copyright (C) 2023 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+// lua
+#include <lua_errno.h>
+
+#define TEMPLATE "/testcase.XXXXXX"
+
+// removes the entries of the directory recursively without following the
+// symbolic links. the dfd is closed by closedir.
+//
+// the descriptor of each directory is kept open while its subdirectories are
+// removed, so the removal keeps one descriptor per level of the tree open and
+// fails with EMFILE if the tree is deeper than the limit of open files.
+static int rmentries(int dfd)
+{
+    DIR *dir = fdopendir(dfd);
+    int rv   = 0;
+
+    if (!dir) {
+        int err = errno;
+        close(dfd);
+        errno = err;
+        return -1;
+    }
+
+    errno = 0;
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+        const char *name = entry->d_name;
+
+        if (name[0] == '.' &&
+            (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            continue;
+        } else if (unlinkat(dirfd(dir), name, 0) == 0) {
+            errno = 0;
+            continue;
+        } else if (errno != EISDIR && errno != EPERM) {
+            // unlink(2) on the directory fails with EISDIR on linux, and
+            // with EPERM on POSIX systems such as macOS
+            rv = -1;
+            break;
+        }
+
+        // remove the subdirectory
+        int fd = openat(dirfd(dir), name,
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd == -1 || rmentries(fd) == -1 ||
+            unlinkat(dirfd(dir), name, AT_REMOVEDIR) == -1) {
+            rv = -1;
+            break;
+        }
+        errno = 0;
+    }
+    if (rv == 0 && errno) {
+        rv = -1;
+    }
+
+    int err = errno;
+    closedir(dir);
+    errno = err;
+    return rv;
+}
+
+static int remove_lua(lua_State *L)
+{
+    const char *pathname = luaL_checkstring(L, 1);
+    int fd = open(pathname, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    if (fd != -1 && rmentries(fd) == 0 && rmdir(pathname) == 0) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "tmpdir.remove");
+    return 2;
+}
+
+static int new_lua(lua_State *L)
+{
+    size_t len         = 0;
+    const char *parent = luaL_checklstring(L, 1, &len);
+    char buf[PATH_MAX] = {0};
+
+    if (len + sizeof(TEMPLATE) > sizeof(buf)) {
+        lua_pushnil(L);
+        lua_errno_new(L, ENAMETOOLONG, "tmpdir.new");
+        return 2;
+    }
+    memcpy(buf, parent, len);
+    memcpy(buf + len, TEMPLATE, sizeof(TEMPLATE));
+    if (mkdtemp(buf)) {
+        lua_pushstring(L, buf);
+        return 1;
+    }
+
+    // got error
+    lua_pushnil(L);
+    lua_errno_new(L, errno, "tmpdir.new");
+    return 2;
+}
+
+LUALIB_API int luaopen_testcase_tmpdir(lua_State *L)
+{
+    struct luaL_Reg funcs[] = {
+        {"new",    new_lua   },
+        {"remove", remove_lua},
+        {NULL,     NULL      }
+    };
+
+    lua_errno_loadlib(L);
+    lua_newtable(L);
+    for (struct luaL_Reg *ptr = funcs; ptr->name; ptr++) {
+        lua_pushcfunction(L, ptr->func);
+        lua_setfield(L, -2, ptr->name);
+    }
+    return 1;
+}
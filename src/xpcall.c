@@ -19,19 +19,232 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
  * DEALINGS IN THE SOFTWARE.
  */
+#include <string.h>
 // lua
 #include <lauxlib.h>
 #include <lua.h>
 
-static int xpcall_lua(lua_State *L)
+#define ERROR_MT "testcase.xpcall.error"
+// registry key of the message handler that captures the error object
+#define CAPTURE_KEY "testcase.xpcall.capture"
+
+// number of the frames captured from the top and the bottom of the stack
+#define LEVELS1 12
+#define LEVELS2 10
+
+#define NAME_LEN 64
+
+/**
+ * the error object holds the error value and the stack frames captured at
+ * the time of the error. the frames are rendered to the traceback string
+ * only when the error object is converted to a string.
+ */
+typedef struct {
+    char source[LUA_IDSIZE];
+    char name[NAME_LEN];
+    int line;
+    int linedefined;
+    char what;
+} frame_t;
+
+typedef struct {
+    // reference to the error value
+    int ref;
+    // reference to the rendered string
+    int str;
+    // number of the frames omitted between LEVELS1 and LEVELS2
+    int nskip;
+    int nframe;
+    frame_t frames[];
+} xpcall_error_t;
+
+static int is_error(lua_State *L, int idx)
+{
+    int rv = 0;
+
+    if (lua_getmetatable(L, idx)) {
+        luaL_getmetatable(L, ERROR_MT);
+        rv = lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
+    }
+    return rv;
+}
+
+static void copystr(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+static int capture_lua(lua_State *L)
+{
+    xpcall_error_t *e = NULL;
+    lua_Debug ar      = {0};
+    int depth         = 0;
+    int nframe        = 0;
+
+    lua_settop(L, 1);
+    if (is_error(L, 1)) {
+        // rethrown error object
+        return 1;
+    }
+
+    // level 0 is this function
+    while (lua_getstack(L, depth + 1, &ar)) {
+        depth++;
+    }
+    nframe = depth;
+    if (nframe > LEVELS1 + LEVELS2) {
+        nframe = LEVELS1 + LEVELS2;
+    }
+
+    e         = lua_newuserdata(L, sizeof(xpcall_error_t) +
+                                       sizeof(frame_t) * (size_t)nframe);
+    e->ref    = LUA_NOREF;
+    e->str    = LUA_NOREF;
+    e->nskip  = depth - nframe;
+    e->nframe = nframe;
+    for (int i = 0; i < nframe; i++) {
+        frame_t *f = e->frames + i;
+        int level  = (i < LEVELS1) ? i + 1 : depth - (nframe - i) + 1;
+
+        lua_getstack(L, level, &ar);
+        lua_getinfo(L, "Sln", &ar);
+        copystr(f->source, ar.short_src, sizeof(f->source));
+        copystr(f->name, ar.name ? ar.name : "", sizeof(f->name));
+        f->line        = ar.currentline;
+        f->linedefined = ar.linedefined;
+        f->what        = *ar.what;
+    }
+    luaL_getmetatable(L, ERROR_MT);
+    lua_setmetatable(L, -2);
+
+    lua_pushvalue(L, 1);
+    e->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return 1;
+}
+
+static void push_message(lua_State *L, int ref)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    if (lua_type(L, -1) == LUA_TSTRING || lua_type(L, -1) == LUA_TNUMBER) {
+        lua_tostring(L, -1);
+        return;
+    } else if (luaL_callmeta(L, -1, "__tostring")) {
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            lua_remove(L, -2);
+            return;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pushfstring(L, "(error object is a %s value)", luaL_typename(L, -1));
+    lua_remove(L, -2);
+}
+
+static int tostring_lua(lua_State *L)
+{
+    xpcall_error_t *e = luaL_checkudata(L, 1, ERROR_MT);
+    luaL_Buffer b;
+
+    if (e->str != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, e->str);
+        return 1;
+    }
+
+    // render the same text as debug.traceback
+    luaL_buffinit(L, &b);
+    push_message(L, e->ref);
+    luaL_addvalue(&b);
+    luaL_addstring(&b, "\nstack traceback:");
+    for (int i = 0; i < e->nframe; i++) {
+        frame_t *f = e->frames + i;
+
+        if (i == LEVELS1 && e->nskip > 0) {
+            luaL_addstring(&b, "\n\t...");
+        }
+        lua_pushfstring(L, "\n\t%s:", f->source);
+        luaL_addvalue(&b);
+        if (f->line > 0) {
+            lua_pushfstring(L, "%d:", f->line);
+            luaL_addvalue(&b);
+        }
+        if (*f->name) {
+            lua_pushfstring(L, " in function '%s'", f->name);
+        } else if (f->what == 'm') {
+            lua_pushliteral(L, " in main chunk");
+        } else if (f->what == 'C') {
+            lua_pushliteral(L, " in ?");
+        } else {
+            lua_pushfstring(L, " in function <%s:%d>", f->source,
+                            f->linedefined);
+        }
+        luaL_addvalue(&b);
+    }
+    luaL_pushresult(&b);
+
+    // cache the rendered string
+    lua_pushvalue(L, -1);
+    e->str = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return 1;
+}
+
+static int value_lua(lua_State *L)
 {
-    int top = lua_gettop(L);
-    int rc  = 0;
-    int ref = LUA_NOREF;
+    xpcall_error_t *e = luaL_checkudata(L, 1, ERROR_MT);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, e->ref);
+    return 1;
+}
 
+static int frames_lua(lua_State *L)
+{
+    xpcall_error_t *e = luaL_checkudata(L, 1, ERROR_MT);
+
+    lua_createtable(L, e->nframe, 0);
+    for (int i = 0; i < e->nframe; i++) {
+        frame_t *f = e->frames + i;
+
+        lua_createtable(L, 0, 3);
+        lua_pushstring(L, f->source);
+        lua_setfield(L, -2, "source");
+        lua_pushinteger(L, f->line);
+        lua_setfield(L, -2, "line");
+        if (*f->name) {
+            lua_pushstring(L, f->name);
+            lua_setfield(L, -2, "name");
+        }
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+static int gc_lua(lua_State *L)
+{
+    xpcall_error_t *e = lua_touserdata(L, 1);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, e->ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, e->str);
+    return 0;
+}
+
+static int xpcall_lua(lua_State *L)
+{
     luaL_checktype(L, 1, LUA_TFUNCTION);
-    luaL_checktype(L, 2, LUA_TFUNCTION);
-    lua_settop(L, 2);
+    if (lua_isnoneornil(L, 2)) {
+        // capture the stack frames without building the traceback string
+        lua_settop(L, 1);
+        lua_pushcfunction(L, capture_lua);
+    } else {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        lua_settop(L, 2);
+    }
 
     lua_pushvalue(L, 1);
     lua_remove(L, 1);
@@ -46,14 +259,41 @@ static int xpcall_lua(lua_State *L)
     // case LUA_ERRERR:
     default:
         lua_pushboolean(L, 0);
-        lua_insert(L, 1);
-        lua_call(L, 1, 1);
+        lua_insert(L, -2);
         return 2;
     }
 }
 
 LUALIB_API int luaopen_testcase_xpcall(lua_State *L)
 {
+    struct luaL_Reg mmethods[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg methods[] = {
+        {"value",  value_lua },
+        {"frames", frames_lua},
+        {NULL,     NULL      }
+    };
+
+    if (luaL_newmetatable(L, ERROR_MT)) {
+        for (struct luaL_Reg *ptr = mmethods; ptr->name; ptr++) {
+            lua_pushcfunction(L, ptr->func);
+            lua_setfield(L, -2, ptr->name);
+        }
+        lua_newtable(L);
+        for (struct luaL_Reg *ptr = methods; ptr->name; ptr++) {
+            lua_pushcfunction(L, ptr->func);
+            lua_setfield(L, -2, ptr->name);
+        }
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+    // other modules call the functions through it to keep the traceback
+    lua_pushcfunction(L, capture_lua);
+    lua_setfield(L, LUA_REGISTRYINDEX, CAPTURE_KEY);
+
     lua_pushcfunction(L, xpcall_lua);
     return 1;
 }
@@ -0,0 +1,44 @@
+local assert = require('assert')
+local affinity = require('testcase.affinity')
+
+local function test_affinity()
+    local cpus, err = affinity.get()
+    if not cpus then
+        -- not supported on this platform
+        assert.match(tostring(err), 'affinity.get')
+        local ok
+        ok, err = affinity.set(0)
+        assert.is_false(ok)
+        assert.match(tostring(err), 'affinity.set')
+        return
+    end
+
+    -- test that returns the CPUs that the process can run on
+    assert.greater(#cpus, 0)
+
+    -- test that pin the process to the CPU
+    assert(affinity.set(cpus[1]))
+    assert.equal(affinity.get(), {
+        cpus[1],
+    })
+
+    -- test that restore the CPUs
+    assert(affinity.set(cpus))
+    assert.equal(affinity.get(), cpus)
+
+    -- test that throws an error with invalid argument
+    for _, v in ipairs({
+        -1,
+        {},
+        {
+            'foo',
+        },
+    }) do
+        err = assert.throws(function()
+            affinity.set(v)
+        end)
+        assert.match(err, '#1')
+    end
+end
+
+test_affinity()
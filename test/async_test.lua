@@ -0,0 +1,211 @@
+local assert = require('assert')
+local async = require('testcase.async')
+local registry = require('testcase.registry')
+local socketpair = require('testcase.socketpair')
+local fork = require('testcase.fork')
+local timer = require('testcase.timer')
+local exit = require('testcase.exit').exit
+
+local function new_handler(results)
+    local events = {}
+    return {
+        start = function(task)
+            events[#events + 1] = 'start ' .. task.id
+        end,
+        resume = function()
+        end,
+        suspend = function()
+        end,
+        finish = function(task)
+            events[#events + 1] = 'finish ' .. task.id
+            results[task.id] = {
+                ok = task.ok,
+                err = task.err,
+            }
+        end,
+    }, events
+end
+
+local function test_sleep()
+    -- test that sleep falls back to timer.sleep outside the scheduler
+    assert.is_false(async.is_scheduled())
+    local t = timer.nanotime()
+    async.sleep(0.05)
+    assert.greater(timer.nanotime() - t, 0.04)
+
+    -- test that the sleeping functions run concurrently
+    local results = {}
+    local handler, events = new_handler(results)
+    t = timer.nanotime()
+    async.run({
+        function()
+            assert.is_true(async.is_scheduled())
+            async.sleep(0.2)
+        end,
+        function()
+            async.sleep(0.1)
+        end,
+        function()
+            async.sleep(0.2)
+        end,
+    }, handler)
+    t = timer.nanotime() - t
+    assert.less(t, 0.4)
+    assert.equal(events, {
+        'start 1',
+        'start 2',
+        'start 3',
+        'finish 2',
+        'finish 1',
+        'finish 3',
+    })
+    for _, res in ipairs(results) do
+        assert.is_true(res.ok)
+    end
+
+    -- test that the sleeping tasks follow the virtual clock if enabled
+    assert.is_false(timer.virtual(true))
+    t = timer.clock()
+    local vt = timer.nanotime()
+    events = {}
+    async.run({
+        function()
+            async.sleep(30)
+            events[#events + 1] = 'wake 1'
+        end,
+        function()
+            async.sleep(10)
+            events[#events + 1] = 'wake 2'
+        end,
+    }, new_handler({}))
+    vt = timer.nanotime() - vt
+    assert.is_true(timer.virtual(false))
+    assert.less(timer.clock() - t, 1000000000)
+    assert.greater(vt, 29.9)
+    assert.equal(events, {
+        'wake 2',
+        'wake 1',
+    })
+
+    -- test that throws an error with invalid argument
+    local err = assert.throws(function()
+        async.sleep(-1)
+    end)
+    assert.match(err, 'unsigned number expected')
+end
+
+local function test_readable()
+    local s1, s2 = assert(socketpair(true))
+
+    -- test that returns false on timeout outside the scheduler
+    assert.is_false(async.readable(s2, 0.01))
+    assert.is_true(async.writable(s1, 0.01))
+
+    -- test that the reader is resumed after the writer writes the data
+    local results = {}
+    local handler, events = new_handler(results)
+    local data
+    async.run({
+        function()
+            assert.is_true(async.readable(s2, 1))
+            data = s2:read()
+        end,
+        function()
+            async.sleep(0.05)
+            assert.is_true(async.writable(s1))
+            s1:write('hello')
+        end,
+        function()
+            -- test that returns false on timeout
+            assert.is_false(async.readable(s1, 0.01))
+        end,
+    }, handler)
+    assert.equal(data, 'hello')
+    assert.equal(events[#events], 'finish 1')
+    for _, res in ipairs(results) do
+        assert.is_true(res.ok)
+    end
+
+    -- test that throws an error if the descriptor is already waited
+    results = {}
+    async.run({
+        function()
+            assert.is_false(async.readable(s2, 0.05))
+        end,
+        function()
+            async.readable(s2, 0.05)
+        end,
+    }, new_handler(results))
+    assert.is_true(results[1].ok)
+    assert.is_false(results[2].ok)
+    assert.match(results[2].err, 'already waited by another test')
+end
+
+local function test_wait()
+    local proc = assert(fork())
+    if proc == 0 then
+        timer.sleep(0.1)
+        exit(3)
+    end
+
+    -- test that wait the child process without blocking other functions
+    local results = {}
+    local handler, events = new_handler(results)
+    local res
+    async.run({
+        function()
+            res = assert(async.wait(proc))
+        end,
+        function()
+            async.sleep(0.01)
+        end,
+    }, handler)
+    assert.equal(res.exit, 3)
+    assert.equal(events, {
+        'start 1',
+        'start 2',
+        'finish 2',
+        'finish 1',
+    })
+end
+
+local function test_error()
+    -- test that the error is reported with traceback
+    local results = {}
+    local handler = new_handler(results)
+    async.run({
+        function()
+            async.sleep(0.01)
+            error('hello error')
+        end,
+        function()
+        end,
+    }, handler)
+    assert.is_false(results[1].ok)
+    assert.match(results[1].err, 'hello error')
+    assert.match(results[1].err, 'stack traceback:')
+    assert.is_true(results[2].ok)
+end
+
+local function test_registry_async()
+    registry.clear()
+
+    -- test that register the async test case
+    assert.is_nil(registry.add('foo', function()
+    end, 'async'))
+    local list = registry.getlist()
+    local _, src = next(list)
+    assert.is_true(src.tests[1].async)
+
+    -- test that setup and teardown functions cannot be async
+    local err = registry.add('before_all', function()
+    end, 'async')
+    assert.match(err, 'before_all cannot be defined as an async function')
+    registry.clear()
+end
+
+test_sleep()
+test_readable()
+test_wait()
+test_error()
+test_registry_async()
@@ -0,0 +1,155 @@
+local assert = require('assert')
+local baseline = require('testcase.baseline')
+
+local function test_median()
+    -- test that returns the median of the values
+    assert.equal(baseline.median({
+        3,
+        1,
+        2,
+    }), 2)
+    assert.equal(baseline.median({
+        4,
+        1,
+        3,
+        2,
+    }), 2.5)
+end
+
+local function test_mannwhitney()
+    -- test that the identical samples are not significant
+    local x = {
+        1,
+        2,
+        3,
+        4,
+        5,
+        6,
+        7,
+        8,
+    }
+    local u, p = baseline.mannwhitney(x, x)
+    assert.equal(u, 32)
+    assert.greater(p, 0.9)
+
+    -- test that the separated samples are significant
+    local y = {
+        11,
+        12,
+        13,
+        14,
+        15,
+        16,
+        17,
+        18,
+    }
+    u, p = baseline.mannwhitney(x, y)
+    assert.equal(u, 0)
+    assert.less(p, 0.01)
+
+    -- test that all tied values are not significant
+    u, p = baseline.mannwhitney({
+        1,
+        1,
+    }, {
+        1,
+        1,
+    })
+    assert.equal(u, 2)
+    assert.equal(p, 1)
+end
+
+local function test_save_load()
+    local pathname = os.tmpname()
+    local samples = {
+        ['test/foo_test.lua:hello'] = {
+            0.001,
+            0.0015,
+            0.002,
+        },
+        ['test/foo_test.lua:world'] = {
+            1.25,
+        },
+    }
+
+    -- test that save the samples to the file
+    assert(baseline.save(pathname, samples))
+
+    -- test that load the samples from the file
+    local res = assert(baseline.load(pathname))
+    assert.equal(res, samples)
+
+    -- test that returns an error with invalid file
+    local f = assert(io.open(pathname, 'w'))
+    f:write('hello\n')
+    f:close()
+    local err
+    res, err = baseline.load(pathname)
+    assert.is_nil(res)
+    assert.match(err, 'unsupported baseline format')
+    os.remove(pathname)
+
+    -- test that returns an error if the file does not exist
+    res, err = baseline.load(pathname)
+    assert.is_nil(res)
+    assert.is_string(err)
+end
+
+local function test_compare()
+    local base = {
+        ['a:same'] = {},
+        ['a:slow'] = {},
+        ['a:fast'] = {},
+        ['a:removed'] = {
+            1,
+        },
+    }
+    local cur = {
+        ['a:same'] = {},
+        ['a:slow'] = {},
+        ['a:fast'] = {},
+        ['a:added'] = {
+            1,
+        },
+    }
+    for i = 1, 10 do
+        base['a:same'][i] = 1 + i / 100
+        cur['a:same'][i] = 1 + i / 100
+        base['a:slow'][i] = 1 + i / 100
+        cur['a:slow'][i] = 2 + i / 100
+        base['a:fast'][i] = 2 + i / 100
+        cur['a:fast'][i] = 1 + i / 100
+    end
+
+    -- test that compares the test cases in both samples
+    local res = baseline.compare(base, cur)
+    assert.equal(#res, 3)
+    assert.equal(res[1].name, 'a:fast')
+    assert.is_true(res[1].significant)
+    assert.is_false(res[1].regression)
+    assert.less(res[1].delta, 0)
+    assert.equal(res[2].name, 'a:same')
+    assert.is_false(res[2].significant)
+    assert.is_false(res[2].regression)
+    assert.equal(res[2].delta, 0)
+    assert.equal(res[3].name, 'a:slow')
+    assert.is_true(res[3].significant)
+    assert.is_true(res[3].regression)
+    assert.greater(res[3].delta, 90)
+
+    -- test that the slowdown within the threshold is not a regression
+    res = baseline.compare(base, cur, 200)
+    assert.is_true(res[3].significant)
+    assert.is_false(res[3].regression)
+
+    -- test that throws an error with invalid threshold
+    local err = assert.throws(function()
+        baseline.compare(base, cur, -1)
+    end)
+    assert.match(err, 'invalid argument #3')
+end
+
+test_median()
+test_mannwhitney()
+test_save_load()
+test_compare()
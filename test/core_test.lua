@@ -0,0 +1,63 @@
+local assert = require('assert')
+
+local function test_core()
+    local preload = {}
+    for k, v in pairs(package.preload) do
+        preload[k] = v
+    end
+
+    -- test that registers the loaders of the native modules to preload
+    package.preload['testcase.xpcall'] = nil
+    package.loaded['testcase.core'] = nil
+    local loaders = require('testcase.core')
+    for _, name in ipairs({
+        'affinity',
+        'chdir',
+        'close',
+        'fork',
+        'fstat',
+        'fsync',
+        'getpid',
+        'icount',
+        'mkdir',
+        'nosigpipe',
+        'poll',
+        'procinfo',
+        'readdir',
+        'realpath',
+        'record',
+        'rlimit',
+        'select',
+        'shm',
+        'shutdown',
+        'socketpair',
+        'timer',
+        'tmpdir',
+        'waitany',
+        'xpcall',
+    }) do
+        name = 'testcase.' .. name
+        assert.is_function(package.preload[name])
+        if not preload[name] then
+            assert.equal(loaders[name], package.preload[name])
+        end
+    end
+
+    -- test that the loader returns the module
+    assert.is_function(package.preload['testcase.xpcall']('testcase.xpcall'))
+
+    -- test that does not overwrite the registered loader
+    local loader = function()
+    end
+    package.preload['testcase.getpid'] = loader
+    package.loaded['testcase.core'] = nil
+    loaders = require('testcase.core')
+    assert.equal(package.preload['testcase.getpid'], loader)
+    assert.is_nil(loaders['testcase.getpid'])
+
+    for k in pairs(package.preload) do
+        package.preload[k] = preload[k]
+    end
+end
+
+test_core()
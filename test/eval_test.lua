@@ -66,7 +66,7 @@ local function test_eval()
         assert(ftest:write([[x = nil + 1]]))
         ok, err = eval(testfile)
         assert(not ok, 'eval() returns true')
-        assert.match(err, 'arithmetic on a nil value')
+        assert.match(tostring(err), 'arithmetic on a nil value')
 
         -- test that returns invalid option value error
         finline:seek('set', 0)
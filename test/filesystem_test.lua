@@ -22,6 +22,33 @@ local function test_chdir()
     assert(fs.chdir('foobarbaz'), 'chdir to "foobarbaz"')
 end
 
+local function test_mkdir()
+    local fs = require('testcase.filesystem')
+    local dirname = os.tmpname()
+    os.remove(dirname)
+
+    -- test that make a directory and its parent directories
+    local err = fs.mkdir(dirname .. '/foo/bar')
+    assert(not err, err)
+    local stat = assert(fs.getstat(dirname .. '/foo/bar'))
+    assert.equal(stat.type, 'directory')
+
+    -- test that ignore the existing directory
+    err = fs.mkdir(dirname .. '/foo/bar')
+    assert(not err, err)
+
+    -- test that returns error if cannot make a directory
+    local f = assert(io.open(dirname .. '/foo/baz', 'w'))
+    f:close()
+    err = fs.mkdir(dirname .. '/foo/baz/qux')
+    assert(err, 'mkdir under the regular file')
+
+    os.remove(dirname .. '/foo/baz')
+    os.remove(dirname .. '/foo/bar')
+    os.remove(dirname .. '/foo')
+    os.remove(dirname)
+end
+
 local function test_getfiles()
     local fs = require('testcase.filesystem')
 
@@ -93,5 +120,6 @@ local function test_getstat()
 end
 
 test_chdir()
+test_mkdir()
 test_getfiles()
 test_getstat()
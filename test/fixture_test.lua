@@ -0,0 +1,95 @@
+local assert = require('assert')
+local fixture = require('testcase.fixture')
+local fork = require('testcase.fork')
+local exit = require('testcase.exit').exit
+
+local function test_shared()
+    local ncall = 0
+    local function builder()
+        ncall = ncall + 1
+        return 'fixture data'
+    end
+
+    -- test that build the fixture only once
+    local m = fixture.shared('test_shared', builder)
+    assert.equal(m:sub(), 'fixture data')
+    assert.equal(fixture.shared('test_shared', builder), m)
+    assert.equal(fixture.shared('test_shared'), m)
+    assert.equal(ncall, 1)
+
+    -- test that the forked child process uses the same fixture
+    local p = assert(fork())
+    if p:is_child() then
+        local v = fixture.shared('test_shared', builder)
+        exit((ncall == 1 and v:sub() == 'fixture data') and 0 or 1)
+    end
+    local res = assert(p:wait())
+    assert.equal(res.exit, 0)
+
+    -- test that rebuild the fixture after released
+    fixture.release('test_shared')
+    fixture.shared('test_shared', builder)
+    assert.equal(ncall, 2)
+    fixture.release('test_shared')
+
+    -- test that throws an error with invalid arguments
+    local err = assert.throws(function()
+        fixture.shared(1)
+    end)
+    assert.match(err, '#1 (string expected, got number)')
+    err = assert.throws(function()
+        fixture.shared('unknown')
+    end)
+    assert.match(err, '#2 (function expected, got nil)')
+    err = assert.throws(function()
+        fixture.shared('unknown', function()
+            return 1
+        end)
+    end)
+    assert.match(err, 'must return a string, got number')
+end
+
+local function test_value()
+    local ncall = 0
+    local function builder()
+        ncall = ncall + 1
+        return {
+            foo = 'bar',
+            list = {
+                1,
+                2,
+                3,
+            },
+        }
+    end
+
+    -- test that returns the decoded table of the fixture
+    local v = fixture.value('test_value', builder)
+    assert.equal(v, {
+        foo = 'bar',
+        list = {
+            1,
+            2,
+            3,
+        },
+    })
+    assert.equal(fixture.value('test_value', builder), v)
+    assert.equal(ncall, 1)
+
+    -- test that the encoded fixture is shared
+    assert.greater(fixture.shared('test_value'):len(), 0)
+    fixture.release('test_value')
+
+    -- test that throws an error if the value cannot be encoded
+    local err = assert.throws(function()
+        fixture.value('test_invalid', function()
+            return {
+                fn = print,
+            }
+        end)
+    end)
+    assert.match(err, 'failed to encode fixture "test_invalid"')
+end
+
+test_shared()
+test_value()
@@ -0,0 +1,114 @@
+local assert = require('assert')
+local fork = require('testcase.fork')
+local waitany = require('testcase.waitany')
+local timer = require('testcase.timer')
+local exit = require('testcase.exit').exit
+
+local function test_wait_nohang()
+    -- test that the module is the fork function
+    assert.is_function(fork)
+
+    local p = assert(fork())
+    if p:is_child() then
+        timer.sleep(0.1)
+        exit(0)
+    end
+
+    -- test that returns again if the child process is running
+    local res, err, again = p:wait(true)
+    assert.is_nil(res)
+    assert.is_nil(err)
+    assert.is_true(again)
+
+    -- test that wait for the child process to exit
+    res = assert(p:wait())
+    assert.equal(res.exit, 0)
+end
+
+local function test_wait_timeout()
+    local p = assert(fork())
+    if p:is_child() then
+        timer.sleep(0.2)
+        exit(0)
+    end
+
+    -- test that returns again after timeout
+    local t = timer.nanotime()
+    local res, err, again = p:wait(0.05)
+    t = timer.nanotime() - t
+    assert.is_nil(res)
+    assert.is_nil(err)
+    assert.is_true(again)
+    assert.less(t, 0.15)
+
+    -- test that returns the result before timeout
+    res = assert(p:wait(5))
+    assert.equal(res.exit, 0)
+
+    -- test that returns error after the child process is reaped
+    res, err = p:wait(5)
+    assert.is_nil(res)
+    assert.is_string(err)
+
+    -- test that throws an error with invalid timeout
+    err = assert.throws(function()
+        p:wait(-1)
+    end)
+    assert.match(err, 'timeout must be >= 0')
+end
+
+local function test_waitany()
+    local procs = {}
+    for i = 1, 3 do
+        local p = assert(fork())
+        if p:is_child() then
+            timer.sleep(0.05 * (4 - i))
+            exit(0)
+        end
+        procs[i] = p
+    end
+
+    -- test that reaps the child process that finishes first
+    local p, res = assert(waitany(procs, 5))
+    assert.equal(p, procs[3])
+    assert.equal(res.exit, 0)
+
+    -- test that returns again after timeout
+    local err, again
+    p, err, again = waitany(procs, true)
+    assert.is_nil(p)
+    assert.is_nil(err)
+    assert.is_true(again)
+
+    -- test that reaps the rest of the child processes
+    for _ = 1, 2 do
+        assert(waitany(procs))
+    end
+
+    -- test that returns error if no child process to wait
+    p, err = waitany(procs)
+    assert.is_nil(p)
+    assert.is_string(err)
+end
+
+local function test_gc()
+    do
+        local p = assert(fork())
+        if p:is_child() then
+            timer.sleep(10)
+            exit(0)
+        end
+    end
+
+    -- test that terminates the child process on garbage collection
+    local t = timer.nanotime()
+    collectgarbage('collect')
+    collectgarbage('collect')
+    t = timer.nanotime() - t
+    assert.less(t, 1)
+end
+
+test_wait_nohang()
+test_wait_timeout()
+test_waitany()
+test_gc()
@@ -0,0 +1,168 @@
+local assert = require('assert')
+local fuzz = require('testcase.fuzz')
+local fs = require('testcase.filesystem')
+local readdir = require('testcase.readdir')
+
+local function has_nul(input)
+    if string.find(input, '%z') then
+        error('found NUL')
+    end
+end
+
+local function test_setopt()
+    -- test that throws an error with invalid option value
+    for _, v in ipairs({
+        {
+            'runs',
+            0,
+        },
+        {
+            'seed',
+            -1,
+        },
+        {
+            'corpus',
+            1,
+        },
+        {
+            'workers',
+            1.5,
+        },
+        {
+            'coverage',
+            'yes',
+        },
+    }) do
+        local err = assert.throws(function()
+            fuzz.setopt(v[1], v[2])
+        end)
+        assert.match(err, 'invalid ' .. v[1] .. ' option')
+    end
+
+    -- test that throws an error with unknown option
+    local err = assert.throws(function()
+        fuzz.setopt('unknown', 1)
+    end)
+    assert.match(err, 'unknown option')
+end
+
+local function test_mutate()
+    -- test that returns a string up to the maxlen
+    fuzz.setopt('maxlen', 16)
+    local input = 'hello'
+    for _ = 1, 1000 do
+        input = fuzz.mutate(input, {
+            '',
+            'world',
+        })
+        assert.is_string(input)
+        assert.less(#input, 17)
+    end
+    fuzz.setopt('maxlen', 4096)
+end
+
+local function test_minimize()
+    -- test that returns the shortest failing input
+    local input = fuzz.minimize(has_nul, 'hello\0world')
+    assert.equal(input, '\0')
+end
+
+local function test_run()
+    fuzz.setopt('runs', 1000)
+    fuzz.setopt('seed', 1)
+
+    -- test that run the target with the generated inputs
+    local ncall = 0
+    fuzz.run('count', function(input)
+        assert.is_string(input)
+        ncall = ncall + 1
+    end)
+    assert.greater(ncall, 999)
+
+    -- test that throws an error with the minimized failing input
+    fuzz.setopt('runs', 100000)
+    local err = assert.throws(function()
+        fuzz.run('has_nul', has_nul)
+    end)
+    assert.match(err, 'fuzz target failed with input')
+    assert.match(err, 'seed: 1')
+    assert.match(err, 'found NUL')
+end
+
+local function test_run_corpus()
+    local dirname = os.tmpname()
+    os.remove(dirname)
+    fuzz.setopt('runs', 100000)
+    fuzz.setopt('seed', 1)
+    fuzz.setopt('corpus', dirname)
+
+    -- test that save the failing input to the corpus directory
+    local err = assert.throws(function()
+        fuzz.run('has_nul', has_nul)
+    end)
+    assert.match(err, 'saved to ' .. dirname .. '/has_nul/crash-')
+    local files = {}
+    assert.is_nil(readdir(dirname .. '/has_nul', function(entry)
+        if not string.find(entry, '^%.') then
+            files[#files + 1] = entry
+        end
+    end))
+    assert.greater(#files, 0)
+
+    -- test that replay the failing input first
+    local ncall = 0
+    err = assert.throws(function()
+        fuzz.run('has_nul', function(input)
+            ncall = ncall + 1
+            has_nul(input)
+        end)
+    end)
+    assert.match(err, 'found NUL')
+    assert.less(ncall, 10)
+
+    fuzz.setopt('corpus', nil)
+    for _, entry in ipairs(files) do
+        os.remove(dirname .. '/has_nul/' .. entry)
+    end
+    os.remove(dirname .. '/has_nul')
+    os.remove(dirname)
+    assert(not fs.getstat(dirname), 'failed to remove the corpus directory')
+end
+
+local function test_run_workers()
+    fuzz.setopt('runs', 1000)
+    fuzz.setopt('seed', 1)
+    fuzz.setopt('workers', 2)
+
+    -- test that the failing input found by the worker is reported
+    fuzz.setopt('runs', 100000)
+    local err = assert.throws(function()
+        fuzz.run('has_nul', has_nul)
+    end)
+    assert.match(err, 'found NUL')
+
+    -- test that the runs are distributed to the workers
+    fuzz.setopt('runs', 1001)
+    local nexec = fuzz.run('noop', function()
+    end)
+    assert.equal(nexec, 1001)
+
+    -- test that the worker exited without the result is reported with its
+    -- seed
+    local exit = require('testcase.exit').exit
+    err = assert.throws(function()
+        fuzz.run('exit', function()
+            exit(3)
+        end)
+    end)
+    assert.match(err, 'fuzz worker #1 exited with status 3')
+    assert.match(err, 'seed: 1')
+    fuzz.setopt('workers', 1)
+end
+
+test_setopt()
+test_mutate()
+test_minimize()
+test_run()
+test_run_corpus()
+test_run_workers()
@@ -0,0 +1,95 @@
+local assert = require('assert')
+local icount = require('testcase.icount')
+local unpack = unpack or table.unpack
+
+local function loop(n)
+    local x = 0
+    for i = 1, n do
+        x = x + i
+    end
+    return x
+end
+
+local function test_measure()
+    -- test that count the VM instructions deterministically
+    local res = icount.measure(loop, 100)
+    assert.greater(res.instructions, 100)
+    assert.equal(icount.measure(loop, 100), res)
+
+    -- test that the number of instructions grows with the work
+    local res2 = icount.measure(loop, 1000)
+    assert.greater(res2.instructions, res.instructions * 5)
+
+    -- test that count the calls of the C functions
+    res = icount.measure(function()
+        for _ = 1, 10 do
+            tostring(1)
+        end
+    end)
+    assert.greater(res.ccalls, 9)
+    res2 = icount.measure(function()
+        for _ = 1, 20 do
+            tostring(1)
+        end
+    end)
+    assert.equal(res2.ccalls - res.ccalls, 10)
+
+    -- test that the nested measurement is included in the outer measurement
+    local inner
+    res = icount.measure(function()
+        inner = icount.measure(loop, 100)
+    end)
+    assert.greater(res.instructions, inner.instructions)
+
+    -- test that the previous hook is restored
+    local prev = {
+        debug.gethook(),
+    }
+    local hook = function()
+    end
+    debug.sethook(hook, '', 1000)
+    icount.measure(loop, 10)
+    local cur = debug.gethook()
+    debug.sethook(unpack(prev))
+    assert.equal(cur, hook)
+
+    -- test that the previous hook is chained and does not change the counts
+    local nline = 0
+    debug.sethook(function(event)
+        if event == 'line' then
+            nline = nline + 1
+        end
+    end, 'l')
+    local chained = icount.measure(loop, 100)
+    debug.sethook(unpack(prev))
+    assert.greater(nline, 100)
+    assert.equal(chained.instructions, icount.measure(loop, 100).instructions)
+
+    -- test that rethrow the error of the function
+    local err = assert.throws(function()
+        icount.measure(function()
+            error('hello')
+        end)
+    end)
+    assert.match(err, 'hello')
+
+    -- test that rethrow the error object that captures the stack frames at
+    -- the error
+    local ok
+    ok, err = pcall(icount.measure, function()
+        error('hello')
+    end)
+    assert.is_false(ok)
+    local frames = err:frames()
+    assert.equal(frames[1].name, 'error')
+    assert.match(frames[2].source, 'icount_test.lua$', false)
+    assert.match(tostring(err), 'hello\nstack traceback:\n', false)
+
+    -- test that throws an error with invalid argument
+    err = assert.throws(function()
+        icount.measure(1)
+    end)
+    assert.match(err, '#1 .+function expected', false)
+end
+
+test_measure()
@@ -0,0 +1,94 @@
+local assert = require('assert')
+local journal = require('testcase.journal')
+local record = require('testcase.record')
+
+local function readfile(pathname)
+    local f = assert(io.open(pathname, 'rb'))
+    local s = f:read('*a')
+    f:close()
+    return s
+end
+
+local function test_event(name, ok)
+    return {
+        event = 'test',
+        file = 'foo_test.lua',
+        name = name,
+        ok = ok,
+        elapsed = 1000,
+    }
+end
+
+local function test_new()
+    local pathname = os.tmpname()
+
+    -- test that write the events to the journal
+    local j = assert(journal.new(pathname))
+    assert(j:write({
+        event = 'file',
+        file = 'foo_test.lua',
+        ntest = 2,
+    }))
+    assert(j:write(test_event('foo', true)))
+    assert(j:write(test_event('bar', false)))
+    assert(j:close())
+    local size = #readfile(pathname)
+    assert.greater(size, 0)
+
+    -- test that append the events to the journal
+    j = assert(journal.new(pathname, true))
+    assert(j:write(test_event('baz', true)))
+    assert(j:close())
+    assert.greater(#readfile(pathname), size)
+
+    -- test that truncate the journal
+    j = assert(journal.new(pathname))
+    assert(j:close())
+    assert.equal(readfile(pathname), '')
+    os.remove(pathname)
+
+    -- test that returns error if the file cannot be opened
+    local err
+    j, err = journal.new('/unknown/dir/journal')
+    assert.is_nil(j)
+    assert.is_string(err)
+end
+
+local function test_load()
+    local pathname = os.tmpname()
+    local j = assert(journal.new(pathname))
+    assert(j:write(test_event('foo', true)))
+    assert(j:write(test_event('bar', false)))
+    assert(j:write(test_event('baz', true)))
+    -- the later failure overrides the former success
+    assert(j:write(test_event('baz', false)))
+    -- the later success overrides the former failure
+    assert(j:write(test_event('bar', true)))
+    assert(j:close())
+    local data = readfile(pathname)
+
+    -- test that returns the succeeded test cases
+    local passed = assert(journal.load(pathname))
+    assert.equal(passed, {
+        ['foo_test.lua:foo'] = test_event('foo', true),
+        ['foo_test.lua:bar'] = test_event('bar', true),
+    })
+
+    -- test that discard the truncated record at the tail
+    local f = assert(io.open(pathname, 'ab'))
+    f:write(string.sub(record.encode(test_event('qux', true)), 1, 10))
+    f:close()
+    passed = assert(journal.load(pathname))
+    assert.is_nil(passed['foo_test.lua:qux'])
+    assert.equal(readfile(pathname), data)
+    os.remove(pathname)
+
+    -- test that returns error if the file does not exist
+    local err
+    passed, err = journal.load(pathname)
+    assert.is_nil(passed)
+    assert.is_string(err)
+end
+
+test_new()
+test_load()
@@ -0,0 +1,90 @@
+local assert = require('assert')
+local loadtest = require('testcase.load')
+local timer = require('testcase.timer')
+
+local function test_run_requests()
+    -- test that run the target for the number of requests
+    local res = loadtest.run('requests', function(i)
+        if i % 10 == 0 then
+            error('error at ' .. i)
+        end
+    end, {
+        workers = 2,
+        requests = 101,
+    })
+    assert.equal(res.name, 'requests')
+    assert.equal(res.workers, 2)
+    assert.equal(res.requests, 101)
+    -- worker #1 runs 51 requests and worker #2 runs 50 requests
+    assert.equal(res.errors, 10)
+    assert.match(res.error, 'error at 10')
+    assert.greater(res.throughput, 0)
+    assert.less(res.min, res.max + 1)
+    assert.less(res.p50, res.p99 + 1)
+    assert.less(res.p99, res.max + 1)
+
+    -- test that the summary is kept in the results
+    local list = loadtest.results()
+    assert.equal(list[#list], res)
+    assert.match(loadtest.tostring(res),
+                 'requests: 2 workers, 101 requests (10 errors)')
+end
+
+local function test_run_duration()
+    -- test that run the target for the duration
+    local t = timer.nanotime()
+    local res = loadtest.run('duration', function()
+        timer.usleep(1000)
+    end, {
+        workers = 2,
+        duration = 0.2,
+    })
+    t = timer.nanotime() - t
+    assert.greater(t, 0.19)
+    assert.greater(res.requests, 10)
+    assert.equal(res.errors, 0)
+    assert.greater(res.p50, 900000)
+end
+
+local function test_run_invalid()
+    -- test that throws an error with invalid arguments
+    for _, v in ipairs({
+        {
+            {},
+            'invalid argument #1',
+        },
+        {
+            'foo',
+            'invalid argument #2',
+        },
+        {
+            'foo',
+            function()
+            end,
+            {
+                workers = 0,
+            },
+            'invalid opts.workers',
+        },
+        {
+            'foo',
+            function()
+            end,
+            {
+                requests = 1,
+                duration = 1,
+            },
+            'cannot be used together',
+        },
+    }) do
+        local errmsg = table.remove(v)
+        local err = assert.throws(function()
+            loadtest.run((unpack or table.unpack)(v))
+        end)
+        assert.match(err, errmsg)
+    end
+end
+
+test_run_requests()
+test_run_duration()
+test_run_invalid()
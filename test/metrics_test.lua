@@ -0,0 +1,122 @@
+local assert = require('assert')
+local metrics = require('testcase.metrics')
+
+local function readfile(pathname)
+    local f = assert(io.open(pathname))
+    local s = f:read('*a')
+    f:close()
+    return s
+end
+
+local function test_write()
+    local pathname = os.tmpname()
+    local events = {
+        {
+            event = 'file',
+            file = 'foo_test.lua',
+            ntest = 2,
+        },
+        {
+            event = 'test',
+            file = 'foo_test.lua',
+            name = 'ok',
+            ok = true,
+            elapsed = 1500,
+        },
+        {
+            event = 'test',
+            file = 'foo_test.lua',
+            name = 'fail "quoted"',
+            ok = false,
+            elapsed = 2000,
+            error = 'error',
+        },
+        {
+            event = 'done',
+            file = 'foo_test.lua',
+            nsuccess = 1,
+            nfailure = 1,
+            errors = {},
+        },
+        {
+            event = 'file',
+            file = 'bar_test.lua',
+            ntest = 1,
+        },
+        {
+            event = 'test',
+            file = 'bar_test.lua',
+            name = 'sampled',
+            ok = true,
+            elapsed = 3000,
+            instructions = 1234,
+            ccalls = 5,
+            samples = {
+                0.000003,
+                0.000001,
+                0.000002,
+            },
+        },
+        {
+            event = 'done',
+            file = 'bar_test.lua',
+            nsuccess = 1,
+            nfailure = 0,
+            errors = {},
+        },
+    }
+
+    -- test that write the metrics in the OpenMetrics text format
+    assert(metrics.write(pathname, events, {
+        nsuccess = 2,
+        nfailure = 1,
+        nloadfailure = 1,
+        total = 1.5e9,
+    }))
+    local s = readfile(pathname)
+    os.remove(pathname)
+    local foo = 'file="foo_test.lua",test='
+    local bar = 'file="bar_test.lua",test="sampled"'
+    for _, line in ipairs({
+        '# TYPE testcase_tests gauge\n',
+        'testcase_tests{result="success"} 2\n',
+        'testcase_tests{result="failure"} 1\n',
+        'testcase_load_failures 1\n',
+        'testcase_duration_seconds 1.500000000\n',
+        'testcase_file_tests{file="foo_test.lua",result="success"} 1\n',
+        'testcase_file_tests{file="bar_test.lua",result="failure"} 0\n',
+        'testcase_test_success{' .. foo .. '"ok"} 1\n',
+        'testcase_test_success{' .. foo .. '"fail \\"quoted\\""} 0\n',
+        '# TYPE testcase_test_duration_seconds summary\n',
+        'testcase_test_duration_seconds_sum{' .. foo .. '"ok"} 0.000001500\n',
+        'testcase_test_duration_seconds_count{' .. foo .. '"ok"} 1\n',
+        'testcase_test_duration_seconds{' .. bar .. ',quantile="0.5"} ' ..
+            '0.000002000\n',
+        'testcase_test_duration_seconds_count{' .. bar .. '} 3\n',
+        '# TYPE testcase_test_instructions gauge\n',
+        'testcase_test_instructions{' .. bar .. '} 1234\n',
+        'testcase_test_ccalls{' .. bar .. '} 5\n',
+    }) do
+        assert.match(s, line)
+    end
+    assert.match(s, '\n# EOF\n$', false)
+
+    -- test that the single sample has no quantiles
+    assert.is_nil(string.find(s, 'test="ok",quantile=', 1, true))
+
+    -- test that the test case without the instruction count is not written
+    assert.is_nil(string.find(s, 'testcase_test_instructions{' .. foo, 1,
+                              true))
+
+    -- test that returns an error if the file cannot be written
+    local ok, err = metrics.write('/nonexistent/dir/metrics.prom', events, {
+        nsuccess = 0,
+        nfailure = 0,
+        nloadfailure = 0,
+        total = 0,
+    })
+    assert.is_false(ok)
+    assert.is_string(err)
+end
+
+test_write()
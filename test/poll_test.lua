@@ -0,0 +1,111 @@
+local assert = require('assert')
+local poll = require('testcase.poll')
+local socketpair = require('testcase.socketpair')
+local fork = require('testcase.fork')
+local timer = require('testcase.timer')
+local exit = require('testcase.exit').exit
+
+local function test_new()
+    -- test that poll.new() returns a poller
+    local p = assert(poll.new())
+    assert.match(tostring(p), '^testcase.poll: ', false)
+
+    -- test that throws an error after closed
+    p:close()
+    local err = assert.throws(function()
+        p:wait()
+    end)
+    assert.match(err, 'attempt to use a closed testcase.poll')
+end
+
+local function test_add_del_wait()
+    local p = assert(poll.new())
+    local s1, s2 = assert(socketpair(true))
+
+    -- test that watch the socket readability
+    assert.is_true(p:add(s2, 'r'))
+
+    -- test that returns empty table on timeout
+    local t = timer.nanotime()
+    local evs = assert(p:wait(0.05))
+    t = timer.nanotime() - t
+    assert.empty(evs)
+    assert.greater(t, 0.04)
+
+    -- test that returns the readable socket
+    assert.equal(s1:write('hello'), 5)
+    evs = assert(p:wait(1))
+    assert.equal(#evs, 1)
+    assert.equal(evs[1].ident, s2)
+    assert.is_true(evs[1].readable)
+
+    -- test that watch the descriptor number
+    assert.is_true(p:add(s1:fd(), 'w'))
+    evs = assert(p:wait(1))
+    assert.equal(#evs, 2)
+
+    -- test that unwatch the socket
+    assert.is_true(p:del(s2))
+    assert.is_false(p:del(s2))
+    evs = assert(p:wait(1))
+    assert.equal(#evs, 1)
+    assert.equal(evs[1].ident, s1:fd())
+    assert.is_true(evs[1].writable)
+
+    -- test that the large timeout does not overflow
+    evs = assert(p:wait(1e12))
+    assert.equal(#evs, 1)
+
+    -- test that watch the reused descriptor number after closed without del
+    assert.is_true(p:del(s1:fd()))
+    local s3, s4 = assert(socketpair(true))
+    local fd = s3:fd()
+    assert.is_true(p:add(fd, 'w'))
+    s3:close()
+    s4:close()
+    s3, s4 = assert(socketpair(true))
+    if s3:fd() == fd then
+        assert.is_true(p:add(fd, 'w'))
+        evs = assert(p:wait(1))
+        assert.equal(#evs, 1)
+        assert.equal(evs[1].ident, fd)
+    end
+    assert.is_true(p:del(fd))
+    s3:close()
+    s4:close()
+
+    -- test that throws an error with invalid ident
+    local err = assert.throws(function()
+        p:add({})
+    end)
+    assert.match(err, 'integer or object with fd() method expected')
+    p:close()
+end
+
+local function test_addproc()
+    local p = assert(poll.new())
+    local proc = assert(fork())
+    if proc:is_child() then
+        timer.sleep(0.05)
+        exit(0)
+    end
+
+    -- test that wait for the child process exit
+    assert.is_true(p:addproc(proc))
+    local evs = assert(p:wait(5))
+    assert.equal(#evs, 1)
+    assert.equal(evs[1].ident, proc)
+    assert.equal(evs[1].pid, proc:pid())
+    assert.is_true(evs[1].exited)
+
+    -- test that the child process is not reaped
+    local res = assert(proc:wait())
+    assert.equal(res.exit, 0)
+    assert.is_true(p:delproc(proc))
+    assert.is_false(p:delproc(proc))
+    p:close()
+end
+
+test_new()
+test_add_del_wait()
+test_addproc()
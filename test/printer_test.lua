@@ -91,6 +91,14 @@ local function test_vstringify()
     assert.match(err, "invalid ")
 end
 
+local function test_fmtsec()
+    -- test that format the seconds with the time unit
+    assert.equal(printer.fmtsec(1.5), '1.500 s')
+    assert.equal(printer.fmtsec(0.0015), '1.500 ms')
+    assert.equal(printer.fmtsec(0.0000015), '1.500 us')
+    assert.equal(printer.fmtsec(0.000000015), '15 ns')
+end
+
 local function test_call_printline()
     -- unrequire
     package.loaded['testcase.printer'] = nil
@@ -185,4 +193,5 @@ end
 test_new()
 test_parse_format()
 test_vstringify()
+test_fmtsec()
 test_call_printline()
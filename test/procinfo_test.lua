@@ -0,0 +1,65 @@
+local assert = require('assert')
+local procinfo = require('testcase.procinfo')
+local socketpair = require('testcase.socketpair')
+local fork = require('testcase.fork')
+local exit = require('testcase.exit').exit
+
+local function test_fds()
+    -- test that returns the open file descriptors
+    local fds = assert(procinfo.fds())
+    assert.is_table(fds[0])
+
+    -- test that returns the opened descriptors with its type
+    local s1, s2 = assert(socketpair())
+    local f = assert(io.open(os.tmpname(), 'w'))
+    local cur = assert(procinfo.fds())
+    assert.equal(cur[s1:fd()].type, 'socket')
+    assert.equal(cur[s2:fd()].type, 'socket')
+    assert.is_nil(fds[s1:fd()])
+    s1:close()
+    s2:close()
+    f:close()
+
+    -- test that the closed descriptors are not listed
+    cur = assert(procinfo.fds())
+    assert.equal(cur, fds)
+end
+
+local function find_child(pid)
+    for _, v in ipairs(assert(procinfo.children())) do
+        if v.pid == pid then
+            return v
+        end
+    end
+end
+
+local function test_children()
+    local list, err = procinfo.children()
+    if not list then
+        -- not supported on this platform
+        assert.match(tostring(err), 'procinfo.children')
+        return
+    end
+
+    -- test that returns the child processes with its state
+    local p = assert(fork())
+    if p:is_child() then
+        exit(0)
+    end
+    local child = find_child(p:pid())
+    for _ = 1, 100 do
+        if child.state == 'zombie' then
+            break
+        end
+        require('testcase.timer').sleep(0.01)
+        child = find_child(p:pid())
+    end
+    assert.equal(child.state, 'zombie')
+
+    -- test that the reaped child process is not listed
+    assert(p:wait())
+    assert.is_nil(find_child(p:pid()))
+end
+
+test_fds()
+test_children()
@@ -0,0 +1,92 @@
+local assert = require('assert')
+local record = require('testcase.record')
+
+local function test_encode_decode()
+    local v = {
+        str = 'hello\0world',
+        int = 123,
+        neg = -123,
+        float = 1.5,
+        inf = math.huge,
+        yes = true,
+        no = false,
+        list = {
+            1,
+            'two',
+            {
+                three = 3,
+            },
+        },
+        [10] = 'ten',
+    }
+
+    -- test that encodes a table into the length-prefixed binary string
+    local s = record.encode(v)
+    assert.is_string(s)
+    local b1, b2, b3, b4 = string.byte(s, 1, 4)
+    assert.equal(((b1 * 256 + b2) * 256 + b3) * 256 + b4, #s - 4)
+
+    -- test that decodes the record and returns the next position
+    local res, pos = record.decode(s)
+    assert.equal(res, v)
+    assert.equal(pos, #s + 1)
+
+    -- test that decodes the consecutive records from the specified position
+    local stream = record.encode({
+        n = 1,
+    }) .. record.encode({
+        n = 2,
+    })
+    res, pos = record.decode(stream)
+    assert.equal(res, {
+        n = 1,
+    })
+    res, pos = record.decode(stream, pos)
+    assert.equal(res, {
+        n = 2,
+    })
+    assert.equal(pos, #stream + 1)
+
+    -- test that returns nil if the record is incomplete
+    assert.is_nil(record.decode(stream, pos))
+    assert.is_nil(record.decode(string.sub(s, 1, 3)))
+    assert.is_nil(record.decode(string.sub(s, 1, #s - 1)))
+
+    -- test that returns an error if the record is malformed
+    local err
+    res, err = record.decode('\0\0\0\1x')
+    assert.is_nil(res)
+    assert.match(err, 'malformed record')
+end
+
+local function test_encode_invalid()
+    -- test that throws an error with unsupported value
+    local err = assert.throws(function()
+        record.encode({
+            fn = function()
+            end,
+        })
+    end)
+    assert.match(err, 'cannot encode a function value')
+
+    -- test that throws an error with too deeply nested table
+    local v = {}
+    local cur = v
+    for _ = 1, 100 do
+        cur.v = {}
+        cur = cur.v
+    end
+    err = assert.throws(function()
+        record.encode(v)
+    end)
+    assert.match(err, 'nested too deeply')
+
+    -- test that throws an error if the argument is not a table
+    err = assert.throws(function()
+        record.encode('foo')
+    end)
+    assert.match(err, 'table expected')
+end
+
+test_encode_decode()
+test_encode_invalid()
@@ -96,6 +96,7 @@ local function test_registry_getlist()
         basename = 'registry_test.lua',
         dirname = 'test',
         name = 'test/registry_test.lua',
+        limits = {},
         tests = {
             -- sorted by lineno
             {
@@ -112,5 +113,162 @@ local function test_registry_getlist()
     })
 end
 
+local function test_registry_setlimit()
+    local registry = require('testcase.registry')
+    registry.clear()
+    local source = debug.getinfo(1, 'S').source
+
+    -- test that set the resource limits of the test case
+    assert(not registry.add('foo', foofn))
+    local err = registry.setlimit(source, 'foo', {
+        cpu = 1,
+    })
+    assert(not err, err)
+    local files = registry.getlist()
+    assert.equal(files[1].limits, {
+        foo = {
+            cpu = 1,
+        },
+    })
+
+    -- test that returns error with invalid arguments
+    err = registry.setlimit(source, 'foo', 1)
+    assert.match(err, '#3 (table expected, got number)')
+    err = registry.setlimit(source, 1, {})
+    assert.match(err, '#2 (string expected, got number)')
+    registry.clear()
+end
+
+local function test_registry_setfilter()
+test_registry_setexclude()
+    local registry = require('testcase.registry')
+    registry.clear()
+
+    for name, func in pairs({
+        bar = barfn,
+        foo = foofn,
+        before_all = before_all,
+    }) do
+        local err = registry.add(name, func)
+        assert(not err, err)
+    end
+
+    -- test that get list of test cases that match the run pattern
+    local err = registry.setfilter('registry_test%.lua:foo$')
+    assert(not err, err)
+    local files, ntest = registry.getlist()
+    assert.equal(ntest, 1)
+    assert.equal(#files, 1)
+    assert.equal(#files[1].tests, 1)
+    assert.equal(files[1].tests[1].name, 'foo')
+    assert.equal(files[1].before_all, before_all)
+
+    -- test that skip the test cases that match the skip pattern
+    err = registry.setfilter(nil, ':foo$')
+    assert(not err, err)
+    files, ntest = registry.getlist()
+    assert.equal(ntest, 1)
+    assert.equal(files[1].tests[1].name, 'bar')
+
+    -- test that the file is excluded if all test cases are filtered out
+    err = registry.setfilter('unknown')
+    assert(not err, err)
+    files, ntest = registry.getlist()
+    assert.equal(ntest, 0)
+    assert.empty(files)
+
+    -- test that returns error with invalid arguments
+    err = registry.setfilter(true)
+    assert.match(err, '#1 (string expected, got boolean)')
+    err = registry.setfilter(nil, '[')
+    assert.match(err, '#2 (invalid pattern')
+    -- test that the error after the literal prefix is detected
+    for _, pattern in ipairs({
+        'a%',
+        'foo[',
+        'a[^',
+        'a%b(',
+        'a%fx',
+        'a(b',
+        'a)',
+        'a%1',
+        'a(%1)',
+    }) do
+        err = registry.setfilter(pattern)
+        assert.match(err, '#1 (invalid pattern')
+    end
+    for _, pattern in ipairs({
+        'a[]]',
+        'a[%]]',
+        'a%b()',
+        'a%f[%w]',
+        'a(b)%1',
+        'a()',
+    }) do
+        err = registry.setfilter(pattern)
+        assert(not err, err)
+    end
+
+    -- test that clear the filter
+    err = registry.setfilter()
+    assert(not err, err)
+    files, ntest = registry.getlist()
+    assert.equal(ntest, 2)
+    assert.equal(#files, 1)
+end
+
+local function test_registry_setexclude()
+    local registry = require('testcase.registry')
+    registry.clear()
+
+    for name, func in pairs({
+        bar = barfn,
+        foo = foofn,
+    }) do
+        local err = registry.add(name, func)
+        assert(not err, err)
+    end
+
+    -- test that the excluded test cases are not listed
+    local err = registry.setexclude({
+        ['test/registry_test.lua:foo'] = true,
+    })
+    assert(not err, err)
+    local files, ntest = registry.getlist()
+    assert.equal(ntest, 1)
+    assert.equal(files[1].tests[1].name, 'bar')
+    assert.equal(registry.excluded(), {
+        ['test/registry_test.lua:foo'] = true,
+    })
+
+    -- test that the excluded test cases filtered out by the patterns or not
+    -- registered are not reported
+    err = registry.setexclude({
+        ['test/registry_test.lua:foo'] = true,
+        ['test/registry_test.lua:baz'] = true,
+    })
+    assert(not err, err)
+    err = registry.setfilter(nil, ':foo$')
+    assert(not err, err)
+    files, ntest = registry.getlist()
+    assert.equal(ntest, 1)
+    assert.equal(registry.excluded(), {})
+    err = registry.setfilter()
+    assert(not err, err)
+
+    -- test that returns error with invalid argument
+    err = registry.setexclude(true)
+    assert.match(err, '#1 (table expected, got boolean)')
+
+    -- test that clear the exclusion
+    err = registry.setexclude()
+    assert(not err, err)
+    files, ntest = registry.getlist()
+    assert.equal(ntest, 2)
+end
+
 test_registry_add()
 test_registry_getlist()
+test_registry_setlimit()
+test_registry_setfilter()
+test_registry_setexclude()
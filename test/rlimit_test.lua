@@ -0,0 +1,102 @@
+local assert = require('assert')
+local rlimit = require('testcase.rlimit')
+
+local function test_get_set()
+test_errmsg()
+    -- test that returns the soft and hard limits
+    local soft, hard = assert(rlimit.get('nofile'))
+    assert.equal(type(soft), 'number')
+    assert.equal(type(hard), 'number')
+    assert(0 <= soft and soft <= hard)
+
+    -- test that change the soft limit
+    local ok, err = rlimit.set('nofile', soft - 1)
+    assert(ok, err)
+    assert.equal(rlimit.get('nofile'), soft - 1)
+    assert(rlimit.set('nofile', soft))
+    assert.equal(rlimit.get('nofile'), soft)
+
+    -- test that returns an error if the soft limit exceeds the hard limit
+    if hard ~= math.huge then
+        ok, err = rlimit.set('nofile', hard + 1)
+        assert.is_false(ok)
+        assert.is_string(err)
+        assert.equal(rlimit.get('nofile'), soft)
+    end
+
+    -- test that throws an error with unknown resource name
+    err = assert.throws(function()
+        rlimit.get('unknown')
+    end)
+    assert.match(err, 'unknown')
+end
+
+local function test_errmsg()
+    -- test that returns the error message of the breached limit
+    for _, k in ipairs({
+        'nofile',
+        'nproc',
+        'as',
+    }) do
+        assert.is_string(rlimit.errmsg(k))
+    end
+    assert.not_equal(rlimit.errmsg('nofile'), rlimit.errmsg('as'))
+
+    -- test that returns nil if the breach is not reported by errno
+    assert.is_nil(rlimit.errmsg('cpu'))
+end
+
+local function test_memory()
+    local ok, err = rlimit.memory(1024 * 1024)
+    if not ok then
+        -- allocator cannot be replaced (e.g. LuaJIT 64bit)
+        assert.match(err, 'not supported')
+        return
+    end
+
+    -- test that the allocation that exceeds the limit fails
+    local list = {}
+    ok, err = pcall(function()
+        for i = 1, 1024 * 1024 do
+            list[i] = string.rep('x', 1024) .. i
+        end
+    end)
+    list = nil
+    assert(rlimit.memory())
+    assert.is_false(ok)
+    assert.match(err, 'not enough memory')
+
+    -- test that returns the name of exceeded limit only once
+    assert.equal(rlimit.exceeded(), 'memory')
+    assert.is_nil(rlimit.exceeded())
+    collectgarbage('collect')
+end
+
+local function test_cpu()
+    -- test that raises an error if the CPU time limit is exceeded
+    assert(rlimit.cpu(0.1))
+    local ok, err = pcall(function()
+        local n = 0
+        while true do
+            n = n + 1
+        end
+    end)
+    assert(rlimit.cpu())
+    assert.is_false(ok)
+    assert.match(err, 'CPU time limit exceeded')
+    assert.equal(rlimit.exceeded(), 'cpu')
+    assert.is_nil(rlimit.exceeded())
+
+    -- test that the disarmed timer does not raise an error
+    assert(rlimit.cpu(0.05))
+    assert(rlimit.cpu())
+    local t = os.clock()
+    while os.clock() - t < 0.1 do
+    end
+    assert.is_nil(rlimit.exceeded())
+end
+
+test_get_set()
+test_errmsg()
+test_memory()
+test_cpu()
@@ -162,6 +162,507 @@ local function test_runner()
             after_all = 1,
             foofn = 1,
         })
+
+        -- test that accumulates the elapsed time into the specified timer
+        local tm = require('testcase.timer').new()
+        ok, err, nsuccess, nfailures, t = runner.run(tm)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nsuccess, 2)
+        assert.equal(nfailures, 1)
+        assert.equal(t, tm)
+        local total = tm:total()
+        assert.greater(total, 0)
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_leakcheck()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        registry.clear()
+
+        local cache = {}
+        local ncall = 0
+        local err = registry.add('leakfn', function()
+            ncall = ncall + 1
+            cache[#cache + 1] = string.rep('x', 1024) .. ncall
+        end)
+        assert(not err, err)
+
+        -- test that run the test case the specified number of times more
+        local events = {}
+        local function listener(event)
+            events[#events + 1] = event
+        end
+        runner.listen(listener)
+        runner.setopt('leakcheck', 3)
+        local nsuccess, nfailures
+        ok, err, nsuccess, nfailures = runner.run()
+        runner.setopt('leakcheck', false)
+        runner.unlisten(listener)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nsuccess, 1)
+        assert.equal(nfailures, 0)
+        assert.equal(ncall, 4)
+
+        -- test that the growth of the heap is reported
+        assert.equal(events[2].name, 'leakfn')
+        assert.greater(events[2].leak, 0)
+
+        -- test that collect the elapsed time samples of each test case
+        ncall = 0
+        runner.setopt('samples', 3)
+        local _, samples
+        ok, err, nsuccess, nfailures, _, _, samples = runner.run()
+        runner.setopt('samples', nil)
+        assert(ok, 'runner did not run')
+        assert.equal(ncall, 3)
+        local key, list = next(samples)
+        assert.match(key, 'runner_test.lua:leakfn$', false)
+        assert.equal(#list, 3)
+        for _, v in ipairs(list) do
+            assert.is_unsigned(v)
+        end
+
+        -- test that run the test cases without the full garbage collection
+        ncall = 0
+        runner.setopt('lean', true)
+        ok, err, nsuccess = runner.run()
+        runner.setopt('lean', nil)
+        assert(ok, 'runner did not run')
+        assert.equal(nsuccess, 1)
+        assert.equal(ncall, 1)
+
+        -- test that throws an error with invalid option value
+        err = assert.throws(function()
+            runner.setopt('leakcheck', 1)
+        end)
+        assert.match(err, 'invalid leakcheck option')
+        err = assert.throws(function()
+            runner.setopt('samples', 0)
+        end)
+        assert.match(err, 'invalid samples option')
+        err = assert.throws(function()
+            runner.setopt('lean', 1)
+        end)
+        assert.match(err, 'invalid lean option')
+
+        -- test that throws an error with unknown option
+        err = assert.throws(function()
+            runner.setopt('unknown', 1)
+        end)
+        assert.match(err, 'unknown option')
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_limit()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        registry.clear()
+
+        local err = registry.add('busyfn', function()
+            -- the error raised by the limit is caught here
+            pcall(function()
+                local n = 0
+                while true do
+                    n = n + 1
+                end
+            end)
+        end)
+        assert(not err, err)
+
+        -- test that the test case fails if the CPU time limit is exceeded
+        runner.setopt('limit', {
+            cpu = 0.1,
+        })
+        local nsuccess, nfailures
+        ok, err, nsuccess, nfailures = runner.run()
+        runner.setopt('limit', nil)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nsuccess, 0)
+        assert.equal(nfailures, 1)
+
+        -- test that the breach of the setrlimit limit is reported
+        registry.clear()
+        local rlimit = require('testcase.rlimit')
+        local nofile = assert(rlimit.get('nofile'))
+        err = registry.add('manyfiles', function()
+            _G.LIMITED_TEST_CALLED = true
+            local files = {}
+            for i = 1, 1024 do
+                files[i] = assert(io.open('/dev/null'))
+            end
+        end)
+        assert(not err, err)
+        runner.setopt('limit', {
+            nofile = 64,
+        })
+        local errors
+        ok, err, nsuccess, nfailures, _, errors = runner.run()
+        runner.setopt('limit', nil)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nfailures, 1)
+        assert.match(errors[1].errors[1].error, 'nofile limit exceeded')
+        -- test that the setrlimit limits are applied in the child process
+        assert.equal(rlimit.get('nofile'), nofile)
+        assert.is_nil(_G.LIMITED_TEST_CALLED)
+
+        -- test that throws an error with invalid option value
+        for _, v in ipairs({
+            1,
+            {
+                cpu = 0,
+            },
+            {
+                unknown = 1,
+            },
+        }) do
+            err = assert.throws(function()
+                runner.setopt('limit', v)
+            end)
+            assert.match(err, 'invalid limit option')
+        end
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_tmpdir()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        local getcwd = require('testcase.getcwd')
+        registry.clear()
+
+        local parent = assert(require('testcase.tmpdir').new('/tmp'))
+        local cwds = {}
+        local err = registry.add('writefn', function()
+            cwds[#cwds + 1] = assert(getcwd())
+            local f = assert(io.open('scratch.txt', 'w'))
+            f:write('hello')
+            f:close()
+            assert(fs.mkdir('a/b/c') == nil)
+        end)
+        assert(not err, err)
+
+        -- test that run the test case in a new scratch directory and remove
+        -- it after the test case
+        runner.setopt('tmpdir', parent)
+        runner.setopt('samples', 2)
+        local nsuccess, nfailures
+        ok, err, nsuccess, nfailures = runner.run()
+        runner.setopt('samples', nil)
+        runner.setopt('tmpdir', false)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nsuccess, 1)
+        assert.equal(nfailures, 0)
+        assert.equal(#cwds, 2)
+        assert.not_equal(cwds[1], cwds[2])
+        for _, dir in ipairs(cwds) do
+            assert.match(dir, '/testcase%.', false)
+            assert.is_nil(require('testcase.fstat')(dir))
+        end
+        assert(require('testcase.tmpdir').remove(parent))
+
+        -- test that throws an error with invalid option value
+        for _, v in ipairs({
+            1,
+            '/unknown/directory',
+        }) do
+            err = assert.throws(function()
+                runner.setopt('tmpdir', v)
+            end)
+            assert.match(err, 'invalid tmpdir option')
+        end
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_fdcheck()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        local socketpair = require('testcase.socketpair')
+        registry.clear()
+
+        local leaked = {}
+        local err = registry.add('leakfd', function()
+            -- the sockets are referenced after the test case
+            leaked[#leaked + 1] = {
+                assert(socketpair()),
+            }
+        end)
+        assert(not err, err)
+        err = registry.add('closefd', function()
+            local s1, s2 = assert(socketpair())
+            s1:close()
+            s2:close()
+        end)
+        assert(not err, err)
+
+        -- test that the test case that leaks the descriptors fails
+        runner.setopt('fdcheck', 'fail')
+        local nsuccess, nfailures, _, errors
+        ok, err, nsuccess, nfailures, _, errors = runner.run()
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nsuccess, 1)
+        assert.equal(nfailures, 1)
+        assert.equal(errors[1].errors[1].name, 'leakfd')
+        assert.match(errors[1].errors[1].error, 'leaked resources: fd %d+ ' ..
+                         '%(socket', false)
+
+        -- test that only print a warning
+        runner.setopt('fdcheck', 'warn')
+        ok, err, nsuccess, nfailures = runner.run()
+        runner.setopt('fdcheck', false)
+        assert(ok, 'runner did not run')
+        assert.equal(nsuccess, 2)
+        assert.equal(nfailures, 0)
+        for _, pair in ipairs(leaked) do
+            pair[1]:close()
+            pair[2]:close()
+        end
+
+        -- test that the descriptors closed by the garbage collector are
+        -- reported
+        registry.clear()
+        err = registry.add('dropfd', function()
+            assert(socketpair())
+        end)
+        assert(not err, err)
+        runner.setopt('fdcheck', 'fail')
+        ok, err, nsuccess, nfailures, _, errors = runner.run()
+        runner.setopt('fdcheck', false)
+        assert(ok, 'runner did not run')
+        assert.equal(nfailures, 1)
+        assert.match(errors[1].errors[1].error, 'closed by gc')
+
+        -- test that throws an error with invalid option value
+        err = assert.throws(function()
+            runner.setopt('fdcheck', 'error')
+        end)
+        assert.match(err, 'invalid fdcheck option')
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_icount()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        registry.clear()
+
+        local err = registry.add('loopfn', function()
+            local x = 0
+            for i = 1, 100 do
+                x = x + i
+            end
+            return x
+        end)
+        assert(not err, err)
+
+        -- test that the instruction counts are passed to the listener
+        local events = {}
+        local function listener(event)
+            events[#events + 1] = event
+        end
+        runner.listen(listener)
+        runner.setopt('icount', true)
+        ok, err = runner.run()
+        runner.setopt('icount', nil)
+        assert(ok, 'runner did not run')
+        assert.greater(events[2].instructions, 100)
+        assert.is_unsigned(events[2].ccalls)
+
+        -- test that the counts are deterministic
+        local first = events[2]
+        events = {}
+        runner.setopt('icount', true)
+        ok, err = runner.run()
+        runner.setopt('icount', nil)
+        runner.unlisten(listener)
+        assert(ok, 'runner did not run')
+        assert.equal(events[2].instructions, first.instructions)
+        assert.equal(events[2].ccalls, first.ccalls)
+
+        -- test that the repeated runs do not overwrite the counts
+        registry.clear()
+        local ncall = 0
+        err = registry.add('growfn', function()
+            ncall = ncall + 1
+            local x = 0
+            for i = 1, ncall * 100 do
+                x = x + i
+            end
+            return x
+        end)
+        assert(not err, err)
+        events = {}
+        runner.listen(listener)
+        runner.setopt('icount', true)
+        runner.setopt('samples', 3)
+        ok, err = runner.run()
+        runner.setopt('samples', nil)
+        runner.setopt('icount', nil)
+        runner.unlisten(listener)
+        assert(ok, 'runner did not run')
+        assert.equal(ncall, 3)
+        assert.less(events[2].instructions, first.instructions * 2)
+
+        -- test that throws an error with invalid option value
+        err = assert.throws(function()
+            runner.setopt('icount', 1)
+        end)
+        assert.match(err, 'invalid icount option')
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_bench()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        registry.clear()
+
+        local ncall = 0
+        local gcstopped = true
+        local err = registry.add('benchfn', function()
+            ncall = ncall + 1
+            -- the first run and the warmup runs are not measured
+            if ncall > 3 then
+                -- 'isrunning' is not supported in lua 5.1
+                local _, running = pcall(collectgarbage, 'isrunning')
+                gcstopped = gcstopped and running ~= true
+            end
+        end)
+        assert(not err, err)
+
+        -- test that run the warmup and the measured runs
+        runner.setopt('bench', {
+            warmup = 2,
+            ['repeat'] = 3,
+        })
+        local nsuccess, _, samples
+        ok, err, nsuccess, _, _, _, samples = runner.run()
+        runner.setopt('bench', nil)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(nsuccess, 1)
+        assert.equal(ncall, 6)
+        assert(gcstopped, 'garbage collector is running in measured runs')
+        local _, list = next(samples)
+        assert.equal(#list, 3)
+
+        -- test that throws an error with invalid option value
+        for _, v in ipairs({
+            1,
+            {
+                warmup = -1,
+            },
+            {
+                ['repeat'] = 1,
+            },
+            {
+                unknown = 1,
+            },
+        }) do
+            err = assert.throws(function()
+                runner.setopt('bench', v)
+            end)
+            assert.match(err, 'invalid bench option')
+        end
+    end)
+
+    fs.chdir()
+    assert(ok, err)
+end
+
+local function test_runner_listen()
+    local fs = require('testcase.filesystem')
+    local ok, err = pcall(function()
+        local registry = require('testcase.registry')
+        local runner = require('testcase.runner')
+        registry.clear()
+
+        local err = registry.add('okfn', function()
+        end)
+        assert(not err, err)
+        err = registry.add('failfn', function()
+            error('failfn error')
+        end)
+        assert(not err, err)
+
+        -- test that the listener receives the events of the runner
+        local events = {}
+        local listener = function(event)
+            events[#events + 1] = event
+        end
+        runner.listen(listener)
+        ok, err = runner.run()
+        runner.unlisten(listener)
+        assert(ok, 'runner did not run')
+        assert(not err, 'runner returns an error')
+        assert.equal(#events, 4)
+        assert.equal(events[1].event, 'file')
+        assert.match(events[1].file, 'runner_test.lua$', false)
+        assert.equal(events[1].ntest, 2)
+        assert.equal(events[2].event, 'test')
+        assert.equal(events[2].name, 'okfn')
+        assert.is_true(events[2].ok)
+        assert.is_unsigned(events[2].elapsed)
+        assert.is_nil(events[2].error)
+        assert.equal(events[3].name, 'failfn')
+        assert.is_false(events[3].ok)
+        assert.match(events[3].error, 'failfn error')
+        assert.equal(events[4].event, 'done')
+        assert.equal(events[4].nsuccess, 1)
+        assert.equal(events[4].nfailure, 1)
+        assert.equal(#events[4].errors, 1)
+        assert.equal(events[4].errors[1].name, 'failfn')
+
+        -- test that the events can be encoded as the records
+        local record = require('testcase.record')
+        for _, event in ipairs(events) do
+            assert.equal(record.decode(record.encode(event)), event)
+        end
+
+        -- test that the removed listener does not receive the events
+        events = {}
+        ok = runner.run()
+        assert(ok, 'runner did not run')
+        assert.equal(#events, 0)
+
+        -- test that throws an error with invalid argument
+        err = assert.throws(function()
+            runner.listen('foo')
+        end)
+        assert.match(err, 'function expected')
     end)
 
     fs.chdir()
@@ -169,3 +670,10 @@ local function test_runner()
 end
 
 test_runner()
+test_runner_leakcheck()
+test_runner_limit()
+test_runner_tmpdir()
+test_runner_fdcheck()
+test_runner_icount()
+test_runner_bench()
+test_runner_listen()
@@ -0,0 +1,128 @@
+local assert = require('assert')
+local shm = require('testcase.shm')
+local fork = require('testcase.fork')
+local exit = require('testcase.exit').exit
+
+local function test_new()
+    -- test that create the read-only shared memory of the string
+    local m = assert(shm('hello world'))
+    assert.match(tostring(m), '^testcase.shm: ', false)
+    assert.equal(m:len(), 11)
+    assert.equal(#m, 11)
+
+    -- test that create the empty shared memory
+    m = assert(shm(''))
+    assert.equal(m:len(), 0)
+    assert.equal(m:sub(), '')
+
+    -- test that throws an error with invalid argument
+    local err = assert.throws(shm)
+    assert.match(err, '#1 .+string expected', false)
+end
+
+local function test_sub()
+    local m = assert(shm('hello world'))
+
+    -- test that returns the substring as same as string.sub
+    for _, v in ipairs({
+        {},
+        {
+            1,
+        },
+        {
+            7,
+        },
+        {
+            -5,
+        },
+        {
+            2,
+            4,
+        },
+        {
+            -5,
+            -2,
+        },
+        {
+            0,
+            100,
+        },
+        {
+            5,
+            2,
+        },
+        {
+            -100,
+            3,
+        },
+    }) do
+        assert.equal(m:sub(v[1], v[2]), string.sub('hello world', v[1] or 1,
+                                                   v[2] or -1))
+    end
+
+    -- test that returns the byte
+    assert.equal(m:byte(), string.byte('h'))
+    assert.equal(m:byte(-1), string.byte('d'))
+    assert.is_nil(m:byte(100))
+end
+
+local function test_find()
+    local m = assert(shm('hello world, hello lua'))
+
+    -- test that find the plain string
+    assert.equal({
+        m:find('hello'),
+    }, {
+        1,
+        5,
+    })
+    assert.equal({
+        m:find('hello', 2),
+    }, {
+        14,
+        18,
+    })
+    assert.equal({
+        m:find('lua', -3),
+    }, {
+        20,
+        22,
+    })
+    assert.equal({
+        m:find('.'),
+    }, {})
+    assert.is_nil(m:find('hello', 100))
+end
+
+local function test_close()
+    local m = assert(shm('hello'))
+
+    -- test that throws an error after closed
+    m:close()
+    local err = assert.throws(function()
+        m:len()
+    end)
+    assert.match(err, 'closed shared memory')
+
+    -- test that close can be called twice
+    m:close()
+end
+
+local function test_fork()
+    local m = assert(shm('shared data'))
+
+    -- test that the forked child process can read the shared memory
+    local p = assert(fork())
+    if p:is_child() then
+        exit(m:sub() == 'shared data' and 0 or 1)
+    end
+    local res = assert(p:wait())
+    assert.equal(res.exit, 0)
+    assert.equal(m:sub(), 'shared data')
+end
+
+test_new()
+test_sub()
+test_find()
+test_close()
+test_fork()
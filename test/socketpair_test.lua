@@ -148,6 +148,133 @@ local function test_shutdown()
     assert.is_true(s:shutdown())
 end
 
+local function test_read_size_and_readall()
+    local s1, s2 = assert(socketpair(true))
+
+    -- test that read up to the specified size
+    assert.equal(s1:write('hello world'), 11)
+    local msg = assert(s2:read(5))
+    assert.equal(msg, 'hello')
+
+    -- test that read all available data
+    local data = string.rep('x', 1024 * 64)
+    local n = assert(s1:write(data))
+    msg = assert(s2:readall())
+    assert.equal(msg, ' world' .. string.sub(data, 1, n))
+
+    -- test that return again if no data available
+    local err, again
+    msg, err, again = s2:readall()
+    assert.is_nil(msg)
+    assert.is_nil(err)
+    assert.is_true(again)
+
+    -- test that read all data until EOF
+    s1:nonblock(false)
+    s2:nonblock(false)
+    assert.equal(s1:write('foo'), 3)
+    assert.equal(s1:write('bar'), 3)
+    s1:close()
+    assert.equal(s2:readall(), 'foobar')
+    assert.is_nil(s2:readall())
+
+    -- test that throw error if size is invalid
+    err = assert.throws(function()
+        s2:read(0)
+    end)
+    assert.match(err, 'size must be greater than 0')
+end
+
+local function test_writev()
+    local s1, s2 = assert(socketpair(true))
+
+    -- test that write the strings of table at once
+    assert.equal(s1:writev({
+        'foo',
+        'bar',
+        'baz',
+    }), 9)
+    assert.equal(s2:read(), 'foobarbaz')
+
+    -- test that throw error if table contains non-string value
+    local err = assert.throws(function()
+        s1:writev({
+            'foo',
+            true,
+        })
+    end)
+    assert.match(err, 'invalid value #2 in table')
+
+    -- test that throw error if table contains too many strings
+    local list = {}
+    for i = 1, 4096 do
+        list[i] = 'x'
+    end
+    err = assert.throws(function()
+        s1:writev(list)
+    end)
+    assert.match(err, 'too many buffers')
+end
+
+local function test_sendfile()
+    local s1, s2 = assert(socketpair(true))
+    local f = assert(io.tmpfile())
+    assert(f:write('hello sendfile'))
+    assert(f:flush())
+
+    -- test that send the contents of file
+    assert.equal(s1:sendfile(f), 14)
+    assert.equal(s2:read(), 'hello sendfile')
+
+    -- test that send the contents of file from the offset
+    assert.equal(s1:sendfile(f, 6, 4), 4)
+    assert.equal(s2:read(), 'send')
+
+    -- test that throw error if count is negative
+    local err = assert.throws(function()
+        s1:sendfile(f, 0, -1)
+    end)
+    assert.match(err, 'count must not be negative')
+
+    -- test that throw error if file is closed
+    f:close()
+    err = assert.throws(function()
+        s1:sendfile(f)
+    end)
+    assert.match(err, 'attempt to use a closed file')
+end
+
+local function test_sendfd_recvfd()
+    local s1, s2 = assert(socketpair(true))
+    local p1, p2 = assert(socketpair(true))
+
+    -- test that send a file descriptor to peer
+    assert.is_true(s1:sendfd(p1:fd()))
+    local fd = assert(s2:recvfd())
+    assert.is_uint(fd)
+    assert.not_equal(fd, p1:fd())
+
+    assert(require('testcase.close')(fd))
+    p1:close()
+    p2:close()
+
+    -- test that keep the stream data if no file descriptor received
+    assert.equal(s1:write('xy'), 2)
+    local err
+    fd, err = s2:recvfd()
+    assert.is_nil(fd)
+    assert.match(err, 'no file descriptor received')
+    assert.equal(s2:read(), 'x')
+    assert.equal(s2:read(), 'y')
+
+    -- test that return again if nothing received
+    local again
+    fd, err, again = s2:recvfd()
+    assert.is_nil(fd)
+    assert.is_nil(err)
+    assert.is_true(again)
+end
+
 test_new()
 test_fd()
 test_nonblock()
@@ -155,3 +282,7 @@ test_recv_and_send_buffer()
 test_return_again()
 test_read_write_close()
 test_shutdown()
+test_read_size_and_readall()
+test_writev()
+test_sendfile()
+test_sendfd_recvfd()
@@ -4,20 +4,39 @@ local getpid = require('testcase.getpid')
 local PID = getpid()
 
 for _, pathname in ipairs({
+    'test/affinity_test.lua',
+    'test/async_test.lua',
+    'test/baseline_test.lua',
     'test/close_test.lua',
+    'test/core_test.lua',
     'test/eval_test.lua',
     'test/exit_test.lua',
     'test/filesystem_test.lua',
+    'test/fixture_test.lua',
+    'test/fork_test.lua',
+    'test/fuzz_test.lua',
     'test/getopts_test.lua',
     'test/getpid_test.lua',
+    'test/icount_test.lua',
     'test/iohook_test.lua',
+    'test/journal_test.lua',
+    'test/load_test.lua',
+    'test/metrics_test.lua',
+    'test/poll_test.lua',
     'test/printer_test.lua',
+    'test/procinfo_test.lua',
+    'test/record_test.lua',
     'test/registry_test.lua',
+    'test/rlimit_test.lua',
     'test/runner_test.lua',
+    'test/shm_test.lua',
     'test/shutdown_test.lua',
     'test/socketpair_test.lua',
     'test/testcase_test.lua',
     'test/timer_test.lua',
+    'test/tmpdir_test.lua',
+    'test/trace_test.lua',
+    'test/xpcall_test.lua',
 }) do
     dofile(pathname)
     if getpid() ~= PID then
@@ -99,6 +99,12 @@ local function test_stop_total_reset()
     total = val2ns(total, unit)
     assert.equal(total, v1 + v2)
 
+    -- test that timer:nsec() returns the total time in integer nanoseconds
+    local ns = t:nsec()
+    assert.is_unsigned(ns)
+    assert.equal(ns % 1, 0)
+    assert.less(math.abs(ns - total), 1000)
+
     -- test that timer:reset() that clear internal values of total and start
     t:reset()
     total, tfmt, tunit = assert(t:total())
@@ -107,8 +113,150 @@ local function test_stop_total_reset()
     assert.equal(tunit, 'ns')
 end
 
+local function test_virtual()
+    -- test that the virtual clock is disabled by default
+    assert.is_false(timer.virtual())
+
+    -- test that enable the virtual clock and returns the previous state
+    assert.is_false(timer.virtual(true))
+    assert.is_true(timer.virtual())
+
+    -- test that sleep and usleep advance the virtual clock instantly
+    local tm = timer.new()
+    tm:start()
+    local t = timer.nanotime()
+    timer.sleep(60)
+    timer.usleep(500000)
+    local elapsed = timer.nanotime() - t
+    assert.greater(elapsed, 60.49)
+    assert.less(elapsed, 60.51)
+
+    -- test that advance the virtual clock manually
+    t = timer.nanotime()
+    timer.advance(1.5)
+    elapsed = timer.nanotime() - t
+    assert.greater(elapsed, 1.49)
+    assert.less(elapsed, 1.51)
+
+    -- test that the timer object uses the real clock
+    local v, _, unit = assert(tm:elapsed())
+    assert.less(val2ns(v, unit), val2ns(1, 's'))
+
+    -- test that throws an error with invalid argument
+    local err = assert.throws(function()
+        timer.advance(-1)
+    end)
+    assert.match(err, 'unsigned number expected')
+    err = assert.throws(function()
+        timer.virtual('true')
+    end)
+    assert.match(err, 'boolean expected')
+
+    -- test that disable the virtual clock
+    assert.is_true(timer.virtual(false))
+    t = timer.nanotime()
+    timer.sleep(0.06)
+    t = timer.nanotime() - t
+    assert.is_true(0.05 < t and t < 0.07)
+
+    -- test that advance throws an error if virtual clock is disabled
+    err = assert.throws(function()
+        timer.advance(1)
+    end)
+    assert.match(err, 'virtual clock is not enabled')
+end
+
+local function test_lap()
+    for _, tsc in ipairs({
+        false,
+        true,
+    }) do
+        local t = timer.new(tsc)
+        assert(t:start())
+
+        -- test that timer:lap() returns the elapsed time in nanoseconds
+        timer.sleep(0.01)
+        local ns = assert(t:lap())
+        assert.is_unsigned(ns)
+        assert.equal(ns % 1, 0)
+        assert.greater(ns, 9000000)
+        assert.less(ns, 50000000)
+
+        -- test that timer:lap() restarts the timer
+        local ns2 = assert(t:lap())
+        assert.less(ns2, ns)
+
+        -- test that the lap time is added to the total time
+        local total, _, unit = assert(t:total())
+        assert.greater(val2ns(total, unit), ns - 1)
+    end
+end
+
+local function test_calibrate()
+    -- test that returns the overhead of the timer in nanoseconds
+    local overhead, tsc_overhead, tsc_nsec = timer.calibrate()
+    assert.is_unsigned(overhead)
+    assert.equal(overhead % 1, 0)
+    assert.less(overhead, 1000000)
+    if tsc_overhead then
+        assert.is_unsigned(tsc_overhead)
+        assert.equal(tsc_overhead % 1, 0)
+        assert.greater(tsc_nsec, 0)
+    end
+
+    -- test that the timer started before the recalibration keeps working
+    local tt = timer.new(true)
+    tt:start()
+    timer.sleep(0.01)
+    timer.calibrate()
+    local ns = assert(tt:lap())
+    assert.greater(ns, 9000000)
+    assert.less(ns, 1000000000)
+
+    -- test that the successive laps are close to zero
+    local t = timer.new()
+    t:start()
+    local min
+    for _ = 1, 100 do
+        local ns = t:lap()
+        if not min or ns < min then
+            min = ns
+        end
+    end
+    assert.less(min, 1000)
+end
+
+local function test_clock_format()
+    -- test that timer.clock() returns the monotonic clock in nanoseconds
+    local ns = assert(timer.clock())
+    assert.is_unsigned(ns)
+    assert.equal(ns % 1, 0)
+    timer.sleep(0.01)
+    assert.greater(timer.clock() - ns, 9000000)
+
+    -- test that timer.format() returns the value, format and unit
+    local v, fmt, unit = timer.format(1500000)
+    assert.equal(v, 1.5)
+    assert.equal(fmt, '%.3f ms')
+    assert.equal(unit, 'ms')
+    v, fmt, unit = timer.format(12)
+    assert.equal(v, 12)
+    assert.equal(fmt, '%d ns')
+    assert.equal(unit, 'ns')
+
+    -- test that throws an error with invalid argument
+    local err = assert.throws(function()
+        timer.format(-1)
+    end)
+    assert.match(err, 'unsigned number expected')
+end
+
 test_usleep()
 test_sleep()
+test_virtual()
+test_lap()
+test_calibrate()
+test_clock_format()
 test_new()
 test_start()
 test_elapsed()
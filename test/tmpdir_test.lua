@@ -0,0 +1,55 @@
+local assert = require('assert')
+local tmpdir = require('testcase.tmpdir')
+local fstat = require('testcase.fstat')
+local mkdir = require('testcase.filesystem').mkdir
+
+local function test_new()
+    -- test that create a new directory in the parent directory
+    local dir = assert(tmpdir.new('/tmp'))
+    assert.match(dir, '^/tmp/testcase%.', false)
+    assert.equal(fstat(dir).type, 'directory')
+
+    -- test that create a unique directory
+    local dir2 = assert(tmpdir.new('/tmp'))
+    assert.not_equal(dir, dir2)
+    assert(tmpdir.remove(dir))
+    assert(tmpdir.remove(dir2))
+
+    -- test that returns error if the parent directory does not exist
+    local err
+    dir, err = tmpdir.new('/unknown/directory')
+    assert.is_nil(dir)
+    assert.match(tostring(err), 'tmpdir.new')
+end
+
+local function test_remove()
+    local dir = assert(tmpdir.new('/tmp'))
+    assert(mkdir(dir .. '/a/b/c') == nil)
+    for _, name in ipairs({
+        '/a/foo.txt',
+        '/a/b/c/bar.txt',
+        '/.hidden',
+    }) do
+        local f = assert(io.open(dir .. name, 'w'))
+        f:close()
+    end
+
+    -- test that remove the directory recursively without following the
+    -- symbolic link
+    local target = assert(tmpdir.new('/tmp'))
+    local f = assert(io.open(target .. '/keep.txt', 'w'))
+    f:close()
+    assert(os.execute('ln -s ' .. target .. ' ' .. dir .. '/a/link'))
+    assert(tmpdir.remove(dir))
+    assert.is_nil(fstat(dir))
+    assert.equal(fstat(target .. '/keep.txt').type, 'file')
+    assert(tmpdir.remove(target))
+
+    -- test that returns error if the directory does not exist
+    local ok, err = tmpdir.remove(dir)
+    assert.is_false(ok)
+    assert.match(tostring(err), 'tmpdir.remove')
+end
+
+test_new()
+test_remove()
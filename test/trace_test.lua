@@ -0,0 +1,64 @@
+local assert = require('assert')
+local trace = require('testcase.trace')
+local fork = require('testcase.fork')
+local getpid = require('testcase.getpid')
+local exit = require('testcase.exit').exit
+
+local function readfile(pathname)
+    local f = assert(io.open(pathname))
+    local s = f:read('*a')
+    f:close()
+    return s
+end
+
+local function test_trace()
+    local pathname = os.tmpname()
+
+    -- test that begin returns nil if the tracing is not started
+    assert.is_false(trace.enabled())
+    assert.is_nil(trace.begin('foo', 'test'))
+    trace.finish(nil)
+
+    -- test that start the tracing
+    assert(trace.start(pathname))
+    assert.is_true(trace.enabled())
+    local ok, err = trace.start(pathname)
+    assert.is_false(ok)
+    assert.match(err, 'already started')
+
+    -- test that write the complete event of the span
+    local span = trace.begin('foo "bar"\n', 'test')
+    assert.is_table(span)
+    trace.finish(span, {
+        ok = true,
+        file = 'foo.lua',
+    })
+
+    -- test that forked child process writes the events in its own track
+    local proc = assert(fork())
+    if proc == 0 then
+        trace.finish(trace.begin('child', 'test'))
+        -- stop does nothing in the child process
+        trace.stop()
+        exit(0)
+    end
+    assert(proc:wait())
+    trace.stop()
+    assert.is_false(trace.enabled())
+
+    local s = readfile(pathname)
+    os.remove(pathname)
+    assert.match(s, '^%[\n', false)
+    assert.match(s, '\n%]\n$', false)
+    assert.match(s, '"name":"foo \\"bar\\"\\n","cat":"test","ph":"X"')
+    assert.match(s, '"args":{')
+    assert.match(s, '"ok":true')
+    assert.match(s, '"file":"foo.lua"')
+    assert.match(s, string.format('"pid":%d,"tid":%d,', getpid(), getpid()))
+    assert.match(s, string.format('"pid":%d,"tid":%d,', proc:pid(),
+                                  proc:pid()))
+    assert.match(s, string.format('"args":{"name":"worker %d"}', proc:pid()))
+    assert.match(s, '"args":{"name":"testcase"}')
+end
+
+test_trace()
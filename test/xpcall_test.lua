@@ -0,0 +1,76 @@
+local assert = require('assert')
+local xpcall = require('testcase.xpcall')
+
+local function test_xpcall()
+    -- test that returns true
+    assert.is_true(xpcall(function()
+    end))
+
+    -- test that calls the handler with the error
+    local ok, err = xpcall(function()
+        error('foo', 0)
+    end, function(e)
+        return 'handled: ' .. e
+    end)
+    assert.is_false(ok)
+    assert.equal(err, 'handled: foo')
+end
+
+local function test_capture()
+    -- test that returns the error object that captures the stack frames
+    local ok, err = xpcall(function()
+        error('foo')
+    end)
+    assert.is_false(ok)
+    assert.equal(type(err), 'userdata')
+    assert.match(err:value(), 'xpcall_test.lua:%d+: foo$', false)
+    local frames = err:frames()
+    assert.greater(#frames, 1)
+    assert.equal(frames[1].source, '[C]')
+    assert.equal(frames[1].name, 'error')
+    assert.match(frames[2].source, 'xpcall_test.lua$', false)
+    assert.greater(frames[2].line, 0)
+
+    -- test that renders the traceback by tostring
+    local s = tostring(err)
+    assert.match(s, '^[^\n]+: foo\nstack traceback:\n', false)
+    assert.match(s, "[C]: in function 'error'")
+    assert.equal(tostring(err), s)
+
+    -- test that the error value is not converted to the string
+    local v = {}
+    ok, err = xpcall(function()
+        error(v)
+    end)
+    assert.is_false(ok)
+    assert.equal(err:value(), v)
+    assert.match(tostring(err), '^%(error object is a table value%)', false)
+
+    -- test that the rethrown error object is returned as it is
+    local inner
+    ok, err = xpcall(function()
+        ok, inner = xpcall(function()
+            error('bar')
+        end)
+        error(inner, 0)
+    end)
+    assert.is_false(ok)
+    assert.equal(err, inner)
+
+    -- test that omits the middle of the deep stack frames
+    local function recurse(n)
+        if n == 0 then
+            error('deep')
+        end
+        recurse(n - 1)
+    end
+    ok, err = xpcall(function()
+        recurse(100)
+    end)
+    assert.is_false(ok)
+    assert.equal(#err:frames(), 22)
+    assert.match(tostring(err), '\n\t...\n')
+end
+
+test_xpcall()
+test_capture()